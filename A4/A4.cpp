@@ -1,30 +1,599 @@
 #include <glm/ext.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
 #include "A4.hpp"
+#include "Checkpoint.hpp"
+#include "Distributed.hpp"
+#include "PngWriter.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "ThreadPool.hpp"
+#include "TileScheduler.hpp"
 
-void A4_Render(
-		// What to render
-		SceneNode * root,
+static RenderSettings s_defaultSettings;
+static std::string s_statsFile;
 
-		// Image to write to, set to a given width and height
-		Image & image,
+// Render threads and the framebuffer A4_RenderToFile renders into, kept
+// from one render to the next (e.g. the frames of gr.render_sequence) for
+// as long as the thread count, or the size and format, stay the same.
+static std::unique_ptr<ThreadPool> s_pool;
+static unsigned int s_poolThreads = 0;
+static std::unique_ptr<Image> s_framebuffer;
 
-		// Viewing parameters
+// Distributed rendering: the worker processes to start and the command
+// line to start them with, the coordinator once they are running, and in a
+// worker, its connection to the coordinator.
+static unsigned int s_workerProcesses = 0;
+static std::vector<std::string> s_workerArgs;
+static std::unique_ptr<RenderCoordinator> s_coordinator;
+static std::unique_ptr<CoordinatorConnection> s_connection;
+
+void A4_SetDefaultSettings(const RenderSettings & settings)
+{
+	s_defaultSettings = settings;
+}
+
+const RenderSettings & A4_DefaultSettings()
+{
+	return s_defaultSettings;
+}
+
+void A4_SetStatsFile(const std::string & filename)
+{
+	s_statsFile = filename;
+}
+
+void A4_SetWorkerProcesses(unsigned int workers, const std::vector<std::string> & args)
+{
+	s_workerProcesses = workers;
+	s_workerArgs = args;
+}
+
+void A4_ServeCoordinator(int socket)
+{
+	s_connection.reset(new CoordinatorConnection(socket));
+}
+
+// Strides of the progressive passes. Each pass traces the pixels on its
+// grid that no earlier pass did, and fills the stride x stride block below
+// and to the right of each with its colour until a finer pass gets there.
+// Tiles are a multiple of the largest stride, so blocks never cross tiles.
+static const uint ProgressiveStrides[] = { 8, 4, 2, 1 };
+static const uint ProgressivePassCount = 4;
+
+//---------------------------------------------------------------------------------------
+static ThreadPool & sharedPool(unsigned int threads)
+{
+	if (!s_pool || s_poolThreads != threads) {
+		s_pool.reset();
+		s_pool.reset(new ThreadPool(threads));
+		s_poolThreads = threads;
+	}
+	return *s_pool;
+}
+
+//---------------------------------------------------------------------------------------
+// The coordinator, if rendering is distributed. The workers are started at
+// the first render rather than up front so that they find the meshes the
+// script loaded already cached.
+static RenderCoordinator * coordinator()
+{
+	if (s_workerProcesses > 0 && !s_coordinator) {
+		s_coordinator.reset(new RenderCoordinator(s_workerProcesses, s_workerArgs));
+	}
+	return s_coordinator.get();
+}
+
+//---------------------------------------------------------------------------------------
+// Edge of the tiles settings asks for. The progressive passes need a
+// multiple of the largest stride, so for them it is rounded up to one.
+static uint tileSize(const RenderSettings & settings)
+{
+	uint size = settings.tileSize > 0 ? settings.tileSize : TileScheduler::DefaultTileSize;
+	if (settings.checkpointInterval > 0.0) {
+		uint stride = ProgressiveStrides[0];
+		size = (size + stride - 1) / stride * stride;
+	}
+	return size;
+}
+
+// trace() times one primary ray in this many; see there.
+static const uint TimingSampleInterval = 64;
+
+// Shadow, reflected and refracted rays start this far (relative to the
+// scene's scale at the hit point) off the surface so they do not hit it
+// again.
+static const float ShadowEpsilon = 1e-4f;
+
+// Reflected and refracted rays that would add less than this to any
+// channel of a pixel are not traced.
+static const float MinRayWeight = 1.0f / 1024.0f;
+
+// Past RenderSettings::rouletteDepth, rays weaker than this are ended at
+// random, surviving with probability weight / RouletteWeight.
+static const float RouletteWeight = 1.0f / 32.0f;
+
+//---------------------------------------------------------------------------------------
+// Turns pixel coordinates into primary rays through the pixel centres.
+struct Camera {
+	Camera(const glm::vec3 & eye, const glm::vec3 & view, const glm::vec3 & up,
+		double fovy, uint width, uint height)
+		: eye(eye)
+		, width(width)
+		, height(height)
+	{
+		glm::vec3 w = glm::normalize(view);
+		glm::vec3 u = glm::normalize(glm::cross(w, up));
+		glm::vec3 v = glm::cross(u, w);
+
+		float halfHeight = (float)std::tan(glm::radians(fovy) / 2.0);
+		float halfWidth = halfHeight * width / height;
+
+		forward = w;
+		right = u * halfWidth;
+		down = -v * halfHeight;
+	}
+
+	Ray primaryRay(float x, float y) const {
+		return rayThrough(x + 0.5f, y + 0.5f);
+	}
+
+	// Ray through a point on the image plane given in pixel units, so that
+	// pixel (x, y) covers [x, x + 1) x [y, y + 1).
+	Ray rayThrough(float px, float py) const {
+		float sx = 2.0f * px / width - 1.0f;
+		float sy = 2.0f * py / height - 1.0f;
+		return Ray(eye, forward + sx * right + sy * down);
+	}
+
+	// Rays through the point (offsetX, offsetY) of pixels (x, y) to
+	// (x + count - 1, y); lanes past count are inactive. Lane i matches
+	// rayThrough(x + i + offsetX, y + offsetY) exactly, so by default
+	// primaryRay(x + i, y).
+	RayPacket primaryPacket(uint x, uint y, uint count,
+		float offsetX = 0.5f, float offsetY = 0.5f) const {
+		using namespace simd;
+		Float px = Float((float)x) + Float::lanes();
+		Float sx = Float(2.0f) * (px + Float(offsetX)) / Float((float)width) - Float(1.0f);
+		float sy = 2.0f * ((float)y + offsetY) / height - 1.0f;
+
+		RayPacket packet;
+		packet.ox = Float(eye.x);
+		packet.oy = Float(eye.y);
+		packet.oz = Float(eye.z);
+		packet.dx = Float(forward.x) + sx * Float(right.x) + Float(sy * down.x);
+		packet.dy = Float(forward.y) + sx * Float(right.y) + Float(sy * down.y);
+		packet.dz = Float(forward.z) + sx * Float(right.z) + Float(sy * down.z);
+		packet.computeInverse();
+		packet.active = Float::lanes() < Float((float)count);
+		return packet;
+	}
+
+	glm::vec3 eye;
+	glm::vec3 forward;
+	glm::vec3 right;
+	glm::vec3 down;
+	uint width;
+	uint height;
+};
+
+//---------------------------------------------------------------------------------------
+// A reflected or refracted ray still to be traced, and what its colour is
+// multiplied by on the way to the pixel.
+struct PendingRay {
+	PendingRay(const Ray & ray, const glm::vec3 & weight, uint depth)
+		: ray(ray)
+		, weight(weight)
+		, depth(depth)
+	{}
+
+	Ray ray;
+	glm::vec3 weight;
+	// Bounces from the primary ray, which is depth 0.
+	uint depth;
+};
+
+//---------------------------------------------------------------------------------------
+// What each render worker keeps to itself, so workers never need to lock
+// anything while tracing.
+struct WorkerState {
+	explicit WorkerState(size_t lightCount)
+		: shadows(lightCount)
+	{}
+
+	ShadowCache shadows;
+	TraceStats stats;
+
+	// The stack of shadeHit(), kept so that tracing does not allocate.
+	std::vector<PendingRay> pendingRays;
+};
+
+//---------------------------------------------------------------------------------------
+// Random numbers for Russian roulette and area light samples. Seeded from
+// where they are used, e.g. a pixel and its primary ray, or a light and a
+// shading point, so an image comes out the same whichever thread or
+// process traces it.
+class SampleRandom {
+public:
+	SampleRandom(uint a, uint b, const glm::vec3 & v)
+		: m_state(a * 0x9e3779b9u ^ b * 0x85ebca6bu)
+	{
+		uint32_t bits[3];
+		std::memcpy(bits, &v[0], sizeof(bits));
+		m_state = mix(m_state ^ mix(bits[0] ^ mix(bits[1] ^ mix(bits[2]))));
+	}
+
+	// Uniform in [0, 1).
+	float next() {
+		m_state += 0x9e3779b9u;
+		return (mix(m_state) >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	// The finaliser of MurmurHash3.
+	static uint32_t mix(uint32_t h) {
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	uint32_t m_state;
+};
+
+//---------------------------------------------------------------------------------------
+// Where a ray hit a surface, as shading needs it.
+struct SurfacePoint {
+	SurfacePoint(const Ray & ray, const Intersection & hit)
+	{
+		p = ray.origin + hit.t * ray.direction;
+		n = glm::normalize(hit.normal);
+		inside = glm::dot(n, ray.direction) > 0.0f;
+		if (inside) {
+			n = -n;
+		}
+		v = -glm::normalize(ray.direction);
+
+		glm::vec3 scale = glm::abs(p);
+		offset = ShadowEpsilon * std::max(1.0f, std::max(scale.x, std::max(scale.y, scale.z)));
+	}
+
+	glm::vec3 p;
+	// Unit normal, turned to face the ray.
+	glm::vec3 n;
+	// Unit vector back along the ray.
+	glm::vec3 v;
+	// Whether the ray hit the back of the surface, leaving a solid.
+	bool inside;
+	// How far off the surface rays from p start.
+	float offset;
+};
+
+//---------------------------------------------------------------------------------------
+// Phong shading of surface by the light at point on light, or nothing if
+// the point is behind the surface or, when testing shadows, blocked; lit
+// says which.
+static glm::vec3 illumination(
+		const CompiledScene & scene,
+		const SurfacePoint & surface,
+		const CompiledMaterial & material,
+		const Light & light,
+		size_t lightIndex,
+		const glm::vec3 & point,
+		bool testShadow,
+		bool & lit,
+		WorkerState & worker
+) {
+	const glm::vec3 & n = surface.n;
+	const glm::vec3 & v = surface.v;
+	glm::vec3 shadowOrigin = surface.p + surface.offset * n;
+
+	glm::vec3 toLight = point - shadowOrigin;
+	float distance = glm::length(toLight);
+	glm::vec3 l = toLight / distance;
+
+	float nDotL = glm::dot(n, l);
+	lit = nDotL > 0.0f && !(testShadow
+		&& worker.shadows.occluded(scene, lightIndex, Ray(shadowOrigin, l), distance, worker.stats));
+	if (!lit) {
+		return glm::vec3(0.0f);
+	}
+
+	glm::vec3 intensity = material.kd * nDotL;
+	if (material.shininess > 0.0f) {
+		glm::vec3 r = 2.0f * nDotL * n - l;
+		float rDotV = std::max(0.0f, glm::dot(r, v));
+		intensity += material.ks * (float)std::pow(rDotV, material.shininess);
+	}
+
+	float attenuation = float(light.falloff[0]
+		+ light.falloff[1] * distance
+		+ light.falloff[2] * distance * distance);
+
+	return light.colour * intensity / attenuation;
+}
+
+//---------------------------------------------------------------------------------------
+// Phong shading of surface by an area light: the average over one sample
+// in each cell of a grid split of the light, jittered within it.
+static glm::vec3 areaIllumination(
+		const CompiledScene & scene,
+		const SurfacePoint & surface,
+		const CompiledMaterial & material,
+		const Light & light,
+		size_t lightIndex,
+		WorkerState & worker
+) {
+	glm::vec3 shadowOrigin = surface.p + surface.offset * surface.n;
+	uint grid = std::max(1u, (uint)std::sqrt((double)light.samples));
+	bool testShadows = true;
+	bool lit;
+
+	if (light.adaptive && grid > 2) {
+		// A first look from the light's four corners, the points that bound
+		// its penumbra. If all agree, the rest of the light is taken to
+		// agree too and needs no shadow rays: only the shading still varies
+		// over it. This is a guess; an occluder smaller than the light can
+		// hide its middle from a point that sees every corner, and its
+		// shadow is then missed. adaptive = false traces every sample.
+		uint cornersLit = 0;
+		for (uint corner = 0; corner < 4; ++corner) {
+			glm::vec3 point = light.samplePoint(float(corner % 2), float(corner / 2), shadowOrigin);
+			illumination(scene, surface, material, light, lightIndex, point, true, lit, worker);
+			cornersLit += lit;
+		}
+		if (cornersLit == 0) {
+			return glm::vec3(0.0f);
+		}
+		testShadows = cornersLit < 4;
+	}
+
+	SampleRandom random((uint)lightIndex, 0, surface.p);
+	glm::vec3 sum(0.0f);
+	for (uint j = 0; j < grid; ++j) {
+		for (uint i = 0; i < grid; ++i) {
+			float s = (i + random.next()) / grid;
+			float t = (j + random.next()) / grid;
+			sum += illumination(scene, surface, material, light, lightIndex,
+				light.samplePoint(s, t, shadowOrigin), testShadows, lit, worker);
+		}
+	}
+	return sum / (float)(grid * grid);
+}
+
+//---------------------------------------------------------------------------------------
+// Phong shading with shadows from every light, hard from point lights and
+// soft from area lights.
+static glm::vec3 shade(
+		const CompiledScene & scene,
+		const SurfacePoint & surface,
+		const CompiledMaterial & material,
+		const glm::vec3 & ambient,
+		const std::list<Light *> & lights,
+		WorkerState & worker
+) {
+	glm::vec3 colour = ambient * material.kd;
+
+	size_t lightIndex = 0;
+	for (const Light * light : lights) {
+		size_t index = lightIndex++;
+		if (light->shape == LightShape::Point) {
+			bool lit;
+			glm::vec3 received = illumination(scene, surface, material, *light, index,
+				light->position, true, lit, worker);
+			if (lit) {
+				colour += received;
+			}
+		} else {
+			colour += areaIllumination(scene, surface, material, *light, index, worker);
+		}
+	}
+
+	return colour;
+}
+
+//---------------------------------------------------------------------------------------
+static glm::vec3 background(uint x, uint y, uint w, uint h)
+{
+	return glm::vec3(
+		// Red: increasing from top to bottom
+		(double)y / h,
+		// Green: increasing from left to right
+		(double)x / w,
+		// Blue: in lower-left and upper-right corners
+		((y < h/2 && x < w/2) || (y >= h/2 && x >= w/2)) ? 1.0 : 0.0);
+}
+
+//---------------------------------------------------------------------------------------
+// Colour seen along a primary ray of pixel (x, y) of a w x h frame that hit
+// at hit: the Phong shading there plus, off mirror and glass, what the
+// reflected and refracted rays see. Those are followed from a stack rather
+// than by recursion, each carrying the weight its colour has in the pixel,
+// and end after settings.maxDepth bounces, once the pixel's budget of them
+// is spent, or by Russian roulette. Rays that miss see the pixel's
+// background.
+static glm::vec3 shadeHit(
+		const CompiledScene & scene,
+		const Ray & ray,
+		const Intersection & hit,
+		uint x,
+		uint y,
+		uint w,
+		uint h,
+		const glm::vec3 & ambient,
+		const std::list<Light *> & lights,
+		const RenderSettings & settings,
+		uint & budget,
+		WorkerState & worker
+) {
+	// Most surfaces spawn nothing.
+	const CompiledMaterial & hitMaterial = scene.materials()[hit.material];
+	if (hitMaterial.reflectivity == 0.0f && hitMaterial.transparency == 0.0f) {
+		return shade(scene, SurfacePoint(ray, hit), hitMaterial, ambient, lights, worker);
+	}
+
+	SampleRandom random(x, y, ray.direction);
+	glm::vec3 missColour = background(x, y, w, h);
+	std::vector<PendingRay> & pending = worker.pendingRays;
+	pending.clear();
+	glm::vec3 colour(0.0f);
+
+	auto spawn = [&](const glm::vec3 & origin, const glm::vec3 & direction,
+			glm::vec3 weight, uint depth) {
+		float strength = std::max(weight.x, std::max(weight.y, weight.z));
+		if (budget == 0 || strength < MinRayWeight) {
+			return;
+		}
+		// Those that survive count for the ones that did not, which keeps
+		// the pixel right on average.
+		if (depth > settings.rouletteDepth && strength < RouletteWeight) {
+			float survival = strength / RouletteWeight;
+			if (random.next() >= survival) {
+				return;
+			}
+			weight /= survival;
+		}
+		--budget;
+		pending.emplace_back(Ray(origin, direction), weight, depth);
+	};
+
+	// Adds the shading at a hit to colour and queues the rays it spawns.
+	auto visit = [&](const Ray & ray, const Intersection & hit, const glm::vec3 & weight,
+			uint depth) {
+		const CompiledMaterial & material = scene.materials()[hit.material];
+		SurfacePoint surface(ray, hit);
+
+		float opaque = 1.0f - material.transparency;
+		float phong = opaque * (1.0f - material.reflectivity);
+		if (phong > 0.0f) {
+			colour += weight * phong * shade(scene, surface, material, ambient, lights, worker);
+		}
+		if (phong == 1.0f || depth >= settings.maxDepth) {
+			return;
+		}
+
+		const glm::vec3 & n = surface.n;
+		glm::vec3 d = -surface.v;
+		float cosIn = glm::dot(surface.v, n);
+		float reflected = opaque * material.reflectivity;
+
+		// Refraction by Snell's law, with the dielectric's share split by
+		// Schlick's approximation to the Fresnel term; all of it is
+		// reflected past the critical angle.
+		float refracted = 0.0f;
+		glm::vec3 refractedDirection(0.0f);
+		if (material.transparency > 0.0f) {
+			float ior = material.refractiveIndex;
+			float eta = surface.inside ? ior : 1.0f / ior;
+			float sinOut2 = eta * eta * (1.0f - cosIn * cosIn);
+			if (sinOut2 < 1.0f) {
+				float cosOut = std::sqrt(1.0f - sinOut2);
+				refractedDirection = eta * d + (eta * cosIn - cosOut) * n;
+
+				float r0 = (1.0f - ior) / (1.0f + ior);
+				r0 *= r0;
+				float c = 1.0f - (surface.inside ? cosOut : cosIn);
+				float fresnel = r0 + (1.0f - r0) * c * c * c * c * c;
+				reflected += material.transparency * fresnel;
+				refracted = material.transparency * (1.0f - fresnel);
+			} else {
+				reflected += material.transparency;
+			}
+		}
+
+		// The stronger ray first, should the budget run out.
+		glm::vec3 reflectOrigin = surface.p + surface.offset * n;
+		glm::vec3 reflectDirection = d + 2.0f * cosIn * n;
+		glm::vec3 refractOrigin = surface.p - surface.offset * n;
+		if (reflected >= refracted) {
+			spawn(reflectOrigin, reflectDirection, reflected * weight, depth + 1);
+			spawn(refractOrigin, refractedDirection, refracted * weight, depth + 1);
+		} else {
+			spawn(refractOrigin, refractedDirection, refracted * weight, depth + 1);
+			spawn(reflectOrigin, reflectDirection, reflected * weight, depth + 1);
+		}
+	};
+
+	visit(ray, hit, glm::vec3(1.0f), 0);
+	while (!pending.empty()) {
+		PendingRay next = pending.back();
+		pending.pop_back();
+
+		++worker.stats.secondaryRays;
+		Intersection nextHit;
+		if (scene.intersect(next.ray, 0.0f, nextHit, &worker.stats)) {
+			++worker.stats.hits;
+			visit(next.ray, nextHit, next.weight, next.depth);
+		} else {
+			colour += next.weight * missColour;
+		}
+	}
+	return colour;
+}
+
+//---------------------------------------------------------------------------------------
+// How different two samples look once written to the image: the largest
+// difference in any channel after clamping to the displayable range.
+static float contrast(const glm::vec3 & a, const glm::vec3 & b)
+{
+	glm::vec3 d = glm::abs(glm::clamp(a, 0.0f, 1.0f) - glm::clamp(b, 0.0f, 1.0f));
+	return std::max(d.x, std::max(d.y, d.z));
+}
+
+//---------------------------------------------------------------------------------------
+// True if pixel (x, y) of image differs from any of its four neighbours by
+// more than threshold.
+static bool onEdge(const Image & image, uint x, uint y, float threshold)
+{
+	auto pixel = [&](uint px, uint py) {
+		return glm::vec3(image(px, py, 0), image(px, py, 1), image(px, py, 2));
+	};
+
+	glm::vec3 centre = pixel(x, y);
+	return (x > 0 && contrast(centre, pixel(x - 1, y)) > threshold)
+		|| (y > 0 && contrast(centre, pixel(x, y - 1)) > threshold)
+		|| (x + 1 < image.width() && contrast(centre, pixel(x + 1, y)) > threshold)
+		|| (y + 1 < image.height() && contrast(centre, pixel(x, y + 1)) > threshold);
+}
+
+//---------------------------------------------------------------------------------------
+// Renders a w x h frame into exactly one of image, which must be that size,
+// and stream, which receives each tile as soon as it is finished. Adds what
+// it counted and how long it took to stats, if given.
+//
+// In a worker process, image and stream are null and only the tiles the
+// coordinator asks for are traced. Returns false if it has gone.
+static bool renderFrame(
+		const CompiledScene & scene,
+		uint w,
+		uint h,
+		Image * image,
+		StreamingPngWriter * stream,
+		const RenderSettings & settings,
 		const glm::vec3 & eye,
 		const glm::vec3 & view,
 		const glm::vec3 & up,
 		double fovy,
-
-		// Lighting parameters
 		const glm::vec3 & ambient,
-		const std::list<Light *> & lights
+		const std::list<Light *> & lights,
+		const std::string & filename,
+		RenderStats * stats
 ) {
 
-  // Fill in raytracing code here...
-
   std::cout << "Calling A4_Render(\n" <<
-		  "\t" << *root <<
-          "\t" << "Image(width:" << image.width() << ", height:" << image.height() << ")\n"
+		  "\t" << scene <<
+          "\t" << "Image(width:" << w << ", height:" << h << ")\n"
           "\t" << "eye:  " << glm::to_string(eye) << std::endl <<
 		  "\t" << "view: " << glm::to_string(view) << std::endl <<
 		  "\t" << "up:   " << glm::to_string(up) << std::endl <<
@@ -38,19 +607,556 @@ void A4_Render(
 	std::cout << "\t}" << std::endl;
 	std:: cout <<")" << std::endl;
 
-	size_t h = image.height();
-	size_t w = image.width();
+	Camera camera(eye, view, up, fovy, w, h);
+
+	// A lap of clock without the cost of reading the clock.
+	const double clockOverhead = Stopwatch::overhead();
+	auto timeTaken = [clockOverhead](Stopwatch & clock) {
+		return std::max(0.0, clock.lap() - clockOverhead);
+	};
+
+	// Colour seen along a ray belonging to pixel (x, y), which spends the
+	// pixel's budget of secondary rays.
+	auto trace = [&](const Ray & ray, uint x, uint y, uint & budget, WorkerState & worker) {
+		// Reading the clock costs about as much as tracing a simple ray, so
+		// only every TimingSampleInterval-th ray is timed, standing in for
+		// the rest.
+		bool timed = worker.stats.primaryRays++ % TimingSampleInterval == 0;
+		Stopwatch clock(timed);
+		Intersection hit;
+		bool found = scene.intersect(ray, 0.0f, hit, &worker.stats);
+		if (timed) {
+			worker.stats.traversalSeconds += TimingSampleInterval * timeTaken(clock);
+		}
+		if (!found) {
+			return background(x, y, w, h);
+		}
+
+		++worker.stats.hits;
+		glm::vec3 colour = shadeHit(scene, ray, hit, x, y, w, h, ambient, lights, settings,
+			budget, worker);
+		if (timed) {
+			worker.stats.shadingSeconds += TimingSampleInterval * timeTaken(clock);
+		}
+		return colour;
+	};
+
+	// Pixels are split into grid x grid subpixels, each traced through its
+	// centre and weighted equally.
+	const uint grid = std::max(1u, (uint)std::sqrt((double)settings.samplesPerPixel));
+	const float sampleWeight = 1.0f / (grid * grid);
+	auto subpixelOffset = [grid](uint i) {
+		return (i + 0.5f) / grid;
+	};
+
+	// Colour of pixel (x, y).
+	auto tracePixel = [&](uint x, uint y, WorkerState & worker) {
+		uint budget = settings.rayBudget;
+		if (grid == 1) {
+			return trace(camera.primaryRay(x, y), x, y, budget, worker);
+		}
+
+		glm::vec3 sum(0.0f);
+		for (uint sy = 0; sy < grid; ++sy) {
+			for (uint sx = 0; sx < grid; ++sx) {
+				sum += trace(camera.rayThrough(x + subpixelOffset(sx), y + subpixelOffset(sy)),
+					x, y, budget, worker);
+			}
+		}
+		return sampleWeight * sum;
+	};
+
+	// Guards image against checkpoints taken while tiles are written, and
+	// the progressive render's position.
+	std::mutex progressMutex;
+	uint progressPass = 0;
+	std::vector<uint8_t> tileDone;
+
+	// Tiles are rendered into a local buffer, rows of colours, and handed
+	// over in one go when finished.
+	auto commitTile = [&](const Tile & tile, const std::vector<glm::vec3> & colours) {
+		uint tileWidth = tile.x1 - tile.x0;
+		uint tileHeight = tile.y1 - tile.y0;
+		if (stream) {
+			stream->writeBlock(tile.x0, tile.y0, tileWidth, tileHeight, &colours[0].x);
+		} else {
+			std::lock_guard<std::mutex> lock(progressMutex);
+			image->setPixels(tile.x0, tile.y0, tileWidth, tileHeight, &colours[0].x);
+		}
+	};
+
+	// Colours of a tile's pixels, as rows, into a zeroed buffer of its size.
+	auto traceTile = [&](const Tile & tile, WorkerState & worker,
+			std::vector<glm::vec3> & colours) {
+		uint tileWidth = tile.x1 - tile.x0;
+		for (uint y = tile.y0; y < tile.y1; ++y) {
+			for (uint x = tile.x0; x < tile.x1; ++x) {
+				colours[(y - tile.y0) * tileWidth + (x - tile.x0)] = tracePixel(x, y, worker);
+			}
+		}
+	};
+
+	// Primary rays are traced a packet at a time along each row of the
+	// tile; shading and shadow rays are still done one ray at a time.
+	auto traceTilePackets = [&](const Tile & tile, WorkerState & worker,
+			std::vector<glm::vec3> & colours) {
+		float t[simd::Width], nx[simd::Width], ny[simd::Width], nz[simd::Width];
+		uint tileWidth = tile.x1 - tile.x0;
+
+		for (uint y = tile.y0; y < tile.y1; ++y) {
+			for (uint x = tile.x0; x < tile.x1; x += simd::Width) {
+				// Each lane is a pixel, whose samples share its budget.
+				uint budgets[simd::Width];
+				std::fill(budgets, budgets + simd::Width, settings.rayBudget);
+
+				for (uint sample = 0; sample < grid * grid; ++sample) {
+					float offsetX = subpixelOffset(sample % grid);
+					float offsetY = subpixelOffset(sample / grid);
+					uint count = std::min<uint>(simd::Width, tile.x1 - x);
+					RayPacket packet = camera.primaryPacket(x, y, count, offsetX, offsetY);
+					PacketIntersection packetHit;
+
+					// As in trace(), only some packets are timed.
+					const uint packetInterval = TimingSampleInterval / simd::Width;
+					bool timed = worker.stats.primaryRays / simd::Width % packetInterval == 0;
+					Stopwatch clock(timed);
+					int found = simd::bits(scene.intersect(packet, 0.0f, packetHit, &worker.stats));
+					if (timed) {
+						worker.stats.traversalSeconds += packetInterval * timeTaken(clock);
+					}
+					worker.stats.primaryRays += count;
+					packetHit.t.store(t);
+					packetHit.nx.store(nx);
+					packetHit.ny.store(ny);
+					packetHit.nz.store(nz);
+
+					for (uint lane = 0; lane < count; ++lane) {
+						glm::vec3 colour;
+						if (found & (1 << lane)) {
+							++worker.stats.hits;
+							Intersection hit(t[lane]);
+							hit.normal = glm::vec3(nx[lane], ny[lane], nz[lane]);
+							hit.material = packetHit.material[lane];
+							Ray ray = camera.rayThrough(x + lane + offsetX, y + offsetY);
+							colour = shadeHit(scene, ray, hit, x + lane, y, w, h, ambient, lights,
+								settings, budgets[lane], worker);
+						} else {
+							colour = background(x + lane, y, w, h);
+						}
+
+						colours[(y - tile.y0) * tileWidth + (x + lane - tile.x0)] +=
+							sampleWeight * colour;
+					}
+					if (timed) {
+						worker.stats.shadingSeconds += packetInterval * timeTaken(clock);
+					}
+				}
+			}
+		}
+	};
+
+	auto renderTile = [&](const Tile & tile, WorkerState & worker) {
+		std::vector<glm::vec3> colours((tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+		if (settings.packetTracing) {
+			traceTilePackets(tile, worker, colours);
+		} else {
+			traceTile(tile, worker, colours);
+		}
+		commitTile(tile, colours);
+	};
+
+	// Average of the four quadrants of the square [px, px + size)^2, each
+	// sampled at its centre. Quadrants that stand out from the average are
+	// split again, down to depth levels in all. All of them spend one budget
+	// of secondary rays.
+	const float threshold = settings.supersamplingThreshold;
+	std::function<glm::vec3(float, float, float, uint, uint, uint, size_t &, uint &,
+		WorkerState &)> refine =
+		[&](float px, float py, float size, uint depth, uint x, uint y, size_t & rays,
+			uint & budget, WorkerState & worker) {
+			float half = 0.5f * size;
+			glm::vec3 samples[4];
+			for (uint i = 0; i < 4; ++i) {
+				float qx = px + half * (i % 2);
+				float qy = py + half * (i / 2);
+				samples[i] = trace(camera.rayThrough(qx + 0.5f * half, qy + 0.5f * half), x, y,
+					budget, worker);
+			}
+			rays += 4;
+
+			glm::vec3 mean = 0.25f * (samples[0] + samples[1] + samples[2] + samples[3]);
+			if (depth <= 1) {
+				return mean;
+			}
+
+			bool changed = false;
+			for (uint i = 0; i < 4; ++i) {
+				if (contrast(samples[i], mean) > threshold) {
+					samples[i] = refine(px + half * (i % 2), py + half * (i / 2), half,
+						depth - 1, x, y, rays, budget, worker);
+					changed = true;
+				}
+			}
+			return changed ? 0.25f * (samples[0] + samples[1] + samples[2] + samples[3]) : mean;
+		};
+
+	// Second pass: supersample the pixels that differ from a neighbour in
+	// the first pass, which is kept aside so tiles can be refined in any
+	// order.
+	std::unique_ptr<Image> firstPass;
+	std::atomic<size_t> refinedPixels(0);
+	std::atomic<size_t> extraRays(0);
+
+	auto refineTile = [&](const Tile & tile, WorkerState & worker) {
+		std::vector<std::pair<glm::uvec2, glm::vec3>> refined;
+		size_t rays = 0;
+		for (uint y = tile.y0; y < tile.y1; ++y) {
+			for (uint x = tile.x0; x < tile.x1; ++x) {
+				if (onEdge(*firstPass, x, y, threshold)) {
+					uint budget = settings.rayBudget;
+					refined.emplace_back(glm::uvec2(x, y),
+						refine((float)x, (float)y, 1.0f, settings.supersamplingDepth, x, y, rays,
+							budget, worker));
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(progressMutex);
+		for (const auto & pixel : refined) {
+			image->setPixels(pixel.first.x, pixel.first.y, 1, 1, &pixel.second.x);
+		}
+		refinedPixels += refined.size();
+		extraRays += rays;
+	};
+
+	// One tile of progressive pass number pass. The tile is rendered into a
+	// local buffer and copied to the image in one go, so a checkpoint never
+	// sees it half done.
+	auto renderTileProgressive = [&](uint pass, size_t index, const Tile & tile,
+			WorkerState & worker) {
+		if (tileDone[index]) {
+			return;
+		}
+
+		uint stride = ProgressiveStrides[pass];
+		uint tileWidth = tile.x1 - tile.x0;
+		std::vector<glm::vec3> colours(tileWidth * (tile.y1 - tile.y0));
+
+		for (uint y = tile.y0; y < tile.y1; y += stride) {
+			for (uint x = tile.x0; x < tile.x1; x += stride) {
+				// Only this tile ever writes these pixels, so they can be
+				// read without the lock.
+				const Image & previous = *image;
+				bool traced = pass > 0 && x % (2 * stride) == 0 && y % (2 * stride) == 0;
+				glm::vec3 colour = traced
+					? glm::vec3(previous(x, y, 0), previous(x, y, 1), previous(x, y, 2))
+					: tracePixel(x, y, worker);
+
+				for (uint by = y; by < std::min(y + stride, tile.y1); ++by) {
+					for (uint bx = x; bx < std::min(x + stride, tile.x1); ++bx) {
+						colours[(by - tile.y0) * tileWidth + (bx - tile.x0)] = colour;
+					}
+				}
+			}
+		}
+
+		commitTile(tile, colours);
+
+		std::lock_guard<std::mutex> lock(progressMutex);
+		tileDone[index] = 1;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	TileScheduler scheduler(w, h, tileSize(settings));
+	ThreadPool * pool = settings.threads != 1 ? &sharedPool(settings.threads) : nullptr;
+
+	std::vector<WorkerState> workers(pool ? pool->size() : 1, WorkerState(lights.size()));
+
+	auto runPass = [&](const std::function<void(const Tile &, WorkerState &)> & pass) {
+		if (pool) {
+			scheduler.run(*pool, [&](unsigned int worker, const Tile & tile) {
+				pass(tile, workers[worker]);
+			});
+		} else {
+			for (const Tile & tile : scheduler.tiles()) {
+				pass(tile, workers[0]);
+			}
+		}
+	};
+
+	RenderCoordinator * farm = s_connection ? nullptr : coordinator();
+	bool progressive = image && settings.checkpointInterval > 0.0 && !filename.empty();
+
+	if (s_connection) {
+		// A worker process: trace tiles for the coordinator on the pool,
+		// and leave everything else about the frame to it.
+		bool served = s_connection->serve(w, h, pool,
+			[&](unsigned int worker, const Tile & tile, std::vector<glm::vec3> & colours) {
+				if (settings.packetTracing) {
+					traceTilePackets(tile, workers[worker], colours);
+				} else {
+					traceTile(tile, workers[worker], colours);
+				}
+			});
+		TraceStats traced;
+		for (const WorkerState & worker : workers) {
+			traced.merge(worker.stats);
+		}
+		if (!served || !s_connection->sendStats(traced)) {
+			return false;
+		}
+	} else if (farm && !progressive) {
+		// The workers and this process share the first pass; supersampling
+		// needs the whole of it and is done here.
+		farm->render(w, h, scheduler.tiles(), pool,
+			[&](unsigned int worker, const Tile & tile) {
+				renderTile(tile, workers[worker]);
+			}, commitTile, workers[0].stats);
+
+		if (image && settings.supersamplingDepth > 0) {
+			firstPass.reset(new Image(*image));
+			runPass(refineTile);
+		}
+	} else if (progressive) {
+		if (farm) {
+			// Still let the workers through the frame to stay in step.
+			std::cout << "Progressive rendering is not distributed; rendering here"
+				<< std::endl;
+			farm->render(w, h, std::vector<Tile>(), pool, TileScheduler::TileTask(), commitTile,
+				workers[0].stats);
+		}
+
+		// Progressive: the image is saved to filename every interval, along
+		// with filename.resume to carry on from if the render is killed.
+		std::string resumeFilename = filename + ".resume";
+		tileDone.assign(scheduler.tiles().size(), 0);
+
+		ResumeState resume;
+		if (resume.load(resumeFilename)
+			&& resume.image.width() == w && resume.image.height() == h
+			&& resume.image.format() == image->format()
+			&& resume.tileDone.size() == tileDone.size()
+			&& resume.pass <= ProgressivePassCount) {
+			std::cout << "Resuming from " << resumeFilename << " at pass "
+				<< resume.pass << std::endl;
+			*image = resume.image;
+			progressPass = resume.pass;
+			tileDone = resume.tileDone;
+		}
+
+		// The supersampling pass is not resumable tile by tile, so once the
+		// progressive passes are done only the preview is updated; a resumed
+		// render redoes supersampling from the finished first pass.
+		CheckpointWriter writer(settings.checkpointInterval, [&]() {
+			ResumeState snapshot;
+			{
+				std::lock_guard<std::mutex> lock(progressMutex);
+				snapshot.pass = progressPass;
+				snapshot.tileDone = tileDone;
+				snapshot.image = *image;
+			}
+
+			saveCheckpointImage(snapshot.image, filename);
+			if (snapshot.pass < ProgressivePassCount) {
+				snapshot.save(resumeFilename);
+			}
+		});
+
+		const Tile * firstTile = scheduler.tiles().data();
+		for (uint pass = progressPass; pass < ProgressivePassCount; ++pass) {
+			runPass([&](const Tile & tile, WorkerState & worker) {
+				renderTileProgressive(pass, &tile - firstTile, tile, worker);
+			});
 
-	for (uint y = 0; y < h; ++y) {
-		for (uint x = 0; x < w; ++x) {
-			// Red: increasing from top to bottom
-			image(x, y, 0) = (double)y / h;
-			// Green: increasing from left to right
-			image(x, y, 1) = (double)x / w;
-			// Blue: in lower-left and upper-right corners
-			image(x, y, 2) = ((y < h/2 && x < w/2)
-						  || (y >= h/2 && x >= w/2)) ? 1.0 : 0.0;
+			std::lock_guard<std::mutex> lock(progressMutex);
+			progressPass = pass + 1;
+			std::fill(tileDone.begin(), tileDone.end(), 0);
 		}
+
+		if (settings.supersamplingDepth > 0) {
+			// Make sure a complete first pass is on disk before spending
+			// time on supersampling.
+			ResumeState finished;
+			finished.pass = ProgressivePassCount;
+			finished.tileDone = tileDone;
+			finished.image = *image;
+			finished.save(resumeFilename);
+
+			firstPass.reset(new Image(*image));
+			runPass(refineTile);
+		}
+
+		writer.stop();
+		std::remove(resumeFilename.c_str());
+	} else {
+		runPass(renderTile);
+
+		if (image && settings.supersamplingDepth > 0) {
+			firstPass.reset(new Image(*image));
+			runPass(refineTile);
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Rendered in " << elapsed.count() << "s (primary rays: ";
+	if (settings.packetTracing) {
+		std::cout << simd::Name << " packets of " << simd::Width;
+	} else {
+		std::cout << "single";
+	}
+	std::cout << ", " << (w * h / elapsed.count() / 1e6) << " Mpixels/s)" << std::endl;
+
+	TraceStats totals;
+	for (const WorkerState & worker : workers) {
+		totals.merge(worker.stats);
+	}
+	if (totals.shadowRays > 0) {
+		std::cout << "Shadow rays: " << totals.shadowRays << ", "
+			<< (100.0 * totals.shadowOccluded / totals.shadowRays) << "% occluded, "
+			<< (100.0 * totals.shadowCacheHits / std::max<uint64_t>(1, totals.shadowOccluded))
+			<< "% of those by the last occluder" << std::endl;
+	}
+
+	if (stats) {
+		stats->width = w;
+		stats->height = h;
+		stats->threads = (unsigned int)workers.size();
+		stats->processes = farm ? farm->size() : 0;
+		stats->trace.merge(totals);
+		stats->addPhase("render", elapsed.count());
+	}
+
+	if (image && settings.supersamplingDepth > 0) {
+		std::cout << "Adaptive supersampling (depth " << settings.supersamplingDepth
+			<< ", threshold " << threshold << "): refined " << refinedPixels
+			<< " of " << (w * h) << " pixels (" << (100.0 * refinedPixels / (w * h))
+			<< "%), " << extraRays << " extra rays ("
+			<< (double(extraRays) / (w * h)) << " per pixel)" << std::endl;
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void A4_Render(
+		// What to render
+		const CompiledScene & scene,
+
+		// Image to write to, set to a given width and height
+		Image & image,
+
+		// How to render it
+		const RenderSettings & settings,
+
+		// Viewing parameters
+		const glm::vec3 & eye,
+		const glm::vec3 & view,
+		const glm::vec3 & up,
+		double fovy,
+
+		// Lighting parameters
+		const glm::vec3 & ambient,
+		const std::list<Light *> & lights,
+
+		// Where the caller will save the image
+		const std::string & filename,
+
+		// Statistics to add to
+		RenderStats * stats
+) {
+	renderFrame(scene, image.width(), image.height(), &image, nullptr, settings,
+		eye, view, up, fovy, ambient, lights, filename, stats);
+}
+
+//---------------------------------------------------------------------------------------
+bool A4_RenderToFile(
+		const CompiledScene & scene,
+		const std::string & filename,
+		uint width,
+		uint height,
+		const RenderSettings & settings,
+		const glm::vec3 & eye,
+		const glm::vec3 & view,
+		const glm::vec3 & up,
+		double fovy,
+		const glm::vec3 & ambient,
+		const std::list<Light *> & lights,
+		RenderStats * stats
+) {
+	if (settings.width > 0 && settings.height > 0) {
+		width = settings.width;
+		height = settings.height;
 	}
 
+	if (s_connection) {
+		// Only the coordinator writes the image. Without it there is
+		// nothing left for a worker to do.
+		if (!renderFrame(scene, width, height, nullptr, nullptr, settings,
+				eye, view, up, fovy, ambient, lights, filename, stats)) {
+			std::cerr << "Lost the coordinator; worker exiting" << std::endl;
+			std::exit(1);
+		}
+		return true;
+	}
+
+	Image::FileType type = Image::fileType(filename);
+	if (settings.streamingOutput && type != Image::FileType::Png) {
+		std::cout << "Streaming output is only available for PNG files; "
+			"keeping the whole image" << std::endl;
+	} else if (settings.streamingOutput) {
+		// Both need the whole frame at once.
+		if (settings.checkpointInterval > 0.0 || settings.supersamplingDepth > 0) {
+			std::cout << "Streaming output is not available with progressive "
+				"rendering or supersampling; keeping the whole image" << std::endl;
+		} else {
+			StreamingPngWriter writer(filename, width, height, tileSize(settings));
+			if (!writer.good()) {
+				std::cerr << "Could not create " << filename << std::endl;
+				return false;
+			}
+
+			renderFrame(scene, width, height, nullptr, &writer, settings,
+				eye, view, up, fovy, ambient, lights, filename, stats);
+
+			std::cout << "Streamed " << filename << ", holding at most "
+				<< writer.peakBands() << " bands of " << tileSize(settings)
+				<< " rows" << std::endl;
+
+			// Encoding happened during the render; only the end is left.
+			Stopwatch save;
+			bool ok = writer.finish();
+			if (stats) {
+				stats->addPhase("save", save.seconds());
+			}
+			return ok;
+		}
+	}
+
+	// Every pixel is rendered again, so the last render's image does not
+	// need clearing.
+	if (!s_framebuffer || s_framebuffer->width() != width || s_framebuffer->height() != height
+		|| s_framebuffer->format() != settings.imageFormat) {
+		s_framebuffer.reset();
+		s_framebuffer.reset(new Image(width, height, settings.imageFormat));
+	}
+	Image & image = *s_framebuffer;
+	A4_Render(scene, image, settings, eye, view, up, fovy, ambient, lights, filename, stats);
+
+	Stopwatch save;
+	bool ok = image.save(filename, type);
+	if (stats) {
+		stats->addPhase("save", save.seconds());
+	}
+	return ok;
+}
+
+//---------------------------------------------------------------------------------------
+void A4_ReportStats(const RenderStats & stats)
+{
+	std::cout << "Stats: ";
+	stats.writeJson(std::cout);
+	if (!s_statsFile.empty()) {
+		stats.saveJson(s_statsFile);
+	}
 }
@@ -2,17 +2,27 @@
 
 #include <glm/glm.hpp>
 
-#include "SceneNode.hpp"
+#include <list>
+#include <string>
+#include <vector>
+
+#include "CompiledScene.hpp"
 #include "Light.hpp"
 #include "Image.hpp"
+#include "RenderSettings.hpp"
+#include "RenderStats.hpp"
 
 void A4_Render(
 		// What to render
-		SceneNode * root,
+		const CompiledScene & scene,
 
 		// Image to write to, set to a given width and height
 		Image & image,
 
+		// How to render it; the size, format and streaming output settings
+		// are A4_RenderToFile's business and ignored here
+		const RenderSettings & settings,
+
 		// Viewing parameters
 		const glm::vec3 & eye,
 		const glm::vec3 & view,
@@ -21,5 +31,56 @@ void A4_Render(
 
 		// Lighting parameters
 		const glm::vec3 & ambient,
-		const std::list<Light *> & lights
+		const std::list<Light *> & lights,
+
+		// Where the caller will save the image
+		const std::string & filename = "",
+
+		// If given, the rays traced, BVH work and render time are added to it
+		RenderStats * stats = nullptr
+);
+
+// Render a width x height image (unless settings give a size) and save it
+// to filename, either through an Image or, with streaming output, tile by
+// tile. A .pfm or .exr extension
+// saves the unclamped floating point values (see Image::FileType); anything
+// else is saved as a PNG. Times the render and the save as phases of stats.
+bool A4_RenderToFile(
+		const CompiledScene & scene,
+		const std::string & filename,
+		uint width,
+		uint height,
+		const RenderSettings & settings,
+		const glm::vec3 & eye,
+		const glm::vec3 & view,
+		const glm::vec3 & up,
+		double fovy,
+		const glm::vec3 & ambient,
+		const std::list<Light *> & lights,
+		RenderStats * stats = nullptr
 );
+
+// Settings for renders that do not say otherwise; see RenderSettings.
+void A4_SetDefaultSettings(const RenderSettings & settings);
+const RenderSettings & A4_DefaultSettings();
+
+// Have A4_ReportStats also save the statistics of each render, as JSON, to
+// filename (overwriting what the previous render wrote). Empty, the
+// default, only prints them.
+void A4_SetStatsFile(const std::string & filename);
+
+// Distribute rendering over workers processes on this host (see
+// Distributed.hpp): from the first render on, each frame's tiles are traced
+// by copies of this program started with args, the command line that runs
+// the same script with the same options (program first), and assembled
+// here. Progressive renders are still rendered locally; supersampling is
+// done locally after the workers' first pass.
+void A4_SetWorkerProcesses(unsigned int workers, const std::vector<std::string> & args);
+
+// Make this process a worker for the coordinator at the other end of
+// socket: its renders trace the tiles the coordinator asks for and write
+// no image.
+void A4_ServeCoordinator(int socket);
+
+// Print stats as JSON, and save them to the stats file if one is set.
+void A4_ReportStats(const RenderStats & stats);
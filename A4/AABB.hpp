@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "Ray.hpp"
+
+// An axis-aligned bounding box. A default constructed box is empty and
+// grows to fit whatever is added to it.
+struct AABB {
+	AABB()
+		: min(std::numeric_limits<float>::infinity())
+		, max(-std::numeric_limits<float>::infinity())
+	{}
+
+	AABB(const glm::vec3 & min, const glm::vec3 & max)
+		: min(min)
+		, max(max)
+	{}
+
+	bool empty() const {
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	void extend(const glm::vec3 & p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void extend(const AABB & other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 centroid() const {
+		return 0.5f * (min + max);
+	}
+
+	float surfaceArea() const {
+		if (empty()) {
+			return 0.0f;
+		}
+		glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// Bounds of this box after transforming it by m.
+	AABB transformed(const glm::mat4 & m) const {
+		AABB result;
+		if (empty()) {
+			return result;
+		}
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner((i & 1) ? max.x : min.x,
+			                 (i & 2) ? max.y : min.y,
+			                 (i & 4) ? max.z : min.z);
+			result.extend(glm::vec3(m * glm::vec4(corner, 1.0f)));
+		}
+		return result;
+	}
+
+	// Slab test: does the ray pass through the box for some t in [tMin, tMax]?
+	bool intersect(const Ray & ray, float tMin, float tMax) const {
+		for (int a = 0; a < 3; ++a) {
+			float t0 = (min[a] - ray.origin[a]) * ray.invDirection[a];
+			float t1 = (max[a] - ray.origin[a]) * ray.invDirection[a];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			// Written so that NaNs (0 * inf) leave the interval unchanged.
+			tMin = t0 > tMin ? t0 : tMin;
+			tMax = t1 < tMax ? t1 : tMax;
+			if (tMin > tMax) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	glm::vec3 min;
+	glm::vec3 max;
+};
@@ -0,0 +1,56 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+const size_t Arena::DefaultBlockSize = 256 * 1024;
+
+//---------------------------------------------------------------------------------------
+Arena::Arena(size_t blockSize)
+	: m_blockSize(std::max<size_t>(blockSize, 64)),
+	  m_next(nullptr),
+	  m_end(nullptr),
+	  m_used(0),
+	  m_reserved(0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+Arena::~Arena()
+{
+	for (auto i = m_destructors.rbegin(); i != m_destructors.rend(); ++i) {
+		i->destroy(i->object);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+size_t Arena::used() const
+{
+	return m_used;
+}
+
+//---------------------------------------------------------------------------------------
+size_t Arena::reserved() const
+{
+	return m_reserved;
+}
+
+//---------------------------------------------------------------------------------------
+void * Arena::allocate(size_t size, size_t alignment)
+{
+	uintptr_t next = (reinterpret_cast<uintptr_t>(m_next) + alignment - 1) & ~(alignment - 1);
+	if (!m_next || next + size > reinterpret_cast<uintptr_t>(m_end)) {
+		// A new block, big enough for an object larger than the usual
+		// size. What was left of the last one is not used again.
+		size_t blockSize = std::max(m_blockSize, size + alignment);
+		m_blocks.emplace_back(new char[blockSize]);
+		m_next = m_blocks.back().get();
+		m_end = m_next + blockSize;
+		m_reserved += blockSize;
+		next = (reinterpret_cast<uintptr_t>(m_next) + alignment - 1) & ~(alignment - 1);
+	}
+
+	m_next = reinterpret_cast<char *>(next + size);
+	m_used += size;
+	return reinterpret_cast<void *>(next);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Owns objects of any type, placed one after another in large blocks and
+ * destroyed together, newest first, when the arena is.
+ *
+ * A scene built by a script is many small objects (nodes, primitives,
+ * materials, lights) that all live exactly as long as the script. Making
+ * them here keeps a subtree's nodes next to each other in memory, costs a
+ * pointer bump per object instead of a trip through malloc, and frees them
+ * in one pass with no ownership to track between them.
+ */
+class Arena {
+public:
+	explicit Arena(size_t blockSize = DefaultBlockSize);
+
+	// Destroys every object made, newest first, then frees the blocks.
+	~Arena();
+
+	// Construct a T from args in the arena. It is destroyed with the arena
+	// and must not be deleted.
+	template <typename T, typename... Args>
+	T * make(Args &&... args);
+
+	// Bytes of objects made, and bytes of blocks allocated for them.
+	size_t used() const;
+	size_t reserved() const;
+
+	static const size_t DefaultBlockSize;
+
+private:
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	// Uninitialised memory for size bytes at the given alignment.
+	void * allocate(size_t size, size_t alignment);
+
+	struct Destructor {
+		void (*destroy)(void * object);
+		void * object;
+	};
+
+	template <typename T>
+	static void destroy(void * object)
+	{
+		static_cast<T *>(object)->~T();
+	}
+
+	size_t m_blockSize;
+	std::vector<std::unique_ptr<char[]>> m_blocks;
+	char * m_next;
+	char * m_end;
+	size_t m_used;
+	size_t m_reserved;
+
+	// Only for objects that need destroying.
+	std::vector<Destructor> m_destructors;
+};
+
+//---------------------------------------------------------------------------------------
+template <typename T, typename... Args>
+T * Arena::make(Args &&... args)
+{
+	void * memory = allocate(sizeof(T), alignof(T));
+	T * object = new (memory) T(std::forward<Args>(args)...);
+	if (!std::is_trivially_destructible<T>::value) {
+		Destructor destructor;
+		destructor.destroy = &Arena::destroy<T>;
+		destructor.object = object;
+		m_destructors.push_back(destructor);
+	}
+	return object;
+}
@@ -0,0 +1,281 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+
+// Number of buckets the centroid range is divided into when looking for
+// the cheapest split.
+static const int SahBinCount = 12;
+
+// Cost of visiting an interior node, relative to one primitive test.
+static const float SahTraversalCost = 0.125f;
+
+//---------------------------------------------------------------------------------------
+BVH::BVH()
+	: m_maxLeafSize(4)
+{
+}
+
+//---------------------------------------------------------------------------------------
+std::vector<uint32_t> BVH::build(
+	const std::vector<AABB> & primitiveBounds, uint32_t maxLeafSize)
+{
+	m_maxLeafSize = std::max<uint32_t>(1, std::min<uint32_t>(maxLeafSize, 0xffff));
+	m_nodes.clear();
+
+	std::vector<BuildItem> items(primitiveBounds.size());
+	for (uint32_t i = 0; i < items.size(); ++i) {
+		items[i].bounds = primitiveBounds[i];
+		items[i].centroid = primitiveBounds[i].centroid();
+		items[i].index = i;
+	}
+
+	std::vector<uint32_t> order;
+	if (items.empty()) {
+		return order;
+	}
+
+	m_nodes.reserve(2 * items.size() / m_maxLeafSize + 1);
+	buildRecursive(items, 0, (uint32_t)items.size(), 0);
+
+	order.reserve(items.size());
+	for (const BuildItem & item : items) {
+		order.push_back(item.index);
+	}
+	return order;
+}
+
+//---------------------------------------------------------------------------------------
+std::vector<uint32_t> BVH::buildLeaf(const std::vector<AABB> & primitiveBounds)
+{
+	if (primitiveBounds.size() > 0xffff) {
+		return build(primitiveBounds);
+	}
+
+	m_nodes.clear();
+	std::vector<uint32_t> order(primitiveBounds.size());
+	if (order.empty()) {
+		return order;
+	}
+
+	BVHNode leaf;
+	for (uint32_t i = 0; i < order.size(); ++i) {
+		leaf.bounds.extend(primitiveBounds[i]);
+		order[i] = i;
+	}
+	leaf.offset = 0;
+	leaf.count = (uint16_t)order.size();
+	leaf.axis = 0;
+	m_nodes.push_back(leaf);
+	return order;
+}
+
+//---------------------------------------------------------------------------------------
+uint32_t BVH::buildRecursive(std::vector<BuildItem> & items,
+	uint32_t begin, uint32_t end, int depth)
+{
+	uint32_t nodeIndex = (uint32_t)m_nodes.size();
+	m_nodes.push_back(BVHNode());
+
+	AABB bounds, centroidBounds;
+	for (uint32_t i = begin; i < end; ++i) {
+		bounds.extend(items[i].bounds);
+		centroidBounds.extend(items[i].centroid);
+	}
+	m_nodes[nodeIndex].bounds = bounds;
+
+	uint32_t count = end - begin;
+
+	auto makeLeaf = [&]() {
+		m_nodes[nodeIndex].offset = begin;
+		m_nodes[nodeIndex].count = (uint16_t)count;
+		m_nodes[nodeIndex].axis = 0;
+		return nodeIndex;
+	};
+
+	bool mustSplit = count > m_maxLeafSize;
+	if (count == 1 || (depth >= MaxDepth - 2 && count <= 0xffff)) {
+		return makeLeaf();
+	}
+
+	// Find the cheapest split along any axis by binning the centroids.
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = std::numeric_limits<float>::infinity();
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		if (extent[axis] <= 0.0f) {
+			continue;
+		}
+
+		AABB binBounds[SahBinCount];
+		uint32_t binCounts[SahBinCount] = { 0 };
+		float scale = SahBinCount / extent[axis];
+
+		for (uint32_t i = begin; i < end; ++i) {
+			int bin = (int)((items[i].centroid[axis] - centroidBounds.min[axis]) * scale);
+			bin = std::min(bin, SahBinCount - 1);
+			binCounts[bin]++;
+			binBounds[bin].extend(items[i].bounds);
+		}
+
+		// Sweep from the right to get the cost of everything above each split.
+		float rightArea[SahBinCount];
+		uint32_t rightCount[SahBinCount];
+		AABB accumulated;
+		uint32_t accumulatedCount = 0;
+		for (int bin = SahBinCount - 1; bin > 0; --bin) {
+			accumulated.extend(binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			rightArea[bin] = accumulated.surfaceArea();
+			rightCount[bin] = accumulatedCount;
+		}
+
+		accumulated = AABB();
+		accumulatedCount = 0;
+		for (int split = 1; split < SahBinCount; ++split) {
+			accumulated.extend(binBounds[split - 1]);
+			accumulatedCount += binCounts[split - 1];
+			if (accumulatedCount == 0 || rightCount[split] == 0) {
+				continue;
+			}
+			float cost = accumulated.surfaceArea() * accumulatedCount
+				+ rightArea[split] * rightCount[split];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0) {
+		float leafCost = (float)count;
+		float splitCost = SahTraversalCost + bestCost / bounds.surfaceArea();
+		if (!mustSplit && leafCost <= splitCost) {
+			return makeLeaf();
+		}
+
+		float scale = SahBinCount / extent[bestAxis];
+		float minimum = centroidBounds.min[bestAxis];
+		BuildItem * middleItem = std::partition(
+			items.data() + begin, items.data() + end,
+			[&](const BuildItem & item) {
+				int bin = (int)((item.centroid[bestAxis] - minimum) * scale);
+				return std::min(bin, SahBinCount - 1) < bestSplit;
+			});
+		middle = (uint32_t)(middleItem - items.data());
+		m_nodes[nodeIndex].axis = (uint16_t)bestAxis;
+	} else {
+		// Every centroid is in the same place, so no split separates them.
+		if (!mustSplit) {
+			return makeLeaf();
+		}
+		middle = begin + count / 2;
+		m_nodes[nodeIndex].axis = 0;
+	}
+
+	m_nodes[nodeIndex].count = 0;
+	buildRecursive(items, begin, middle, depth + 1);
+	uint32_t right = buildRecursive(items, middle, end, depth + 1);
+	m_nodes[nodeIndex].offset = right;
+
+	return nodeIndex;
+}
+
+//---------------------------------------------------------------------------------------
+void BVH::refit(const std::vector<AABB> & primitiveBounds)
+{
+	// A node's children always come after it, so going backwards reaches
+	// both before their parent.
+	for (size_t i = m_nodes.size(); i-- > 0;) {
+		BVHNode & node = m_nodes[i];
+		AABB bounds;
+		if (node.count > 0) {
+			for (uint32_t p = node.offset; p < node.offset + node.count; ++p) {
+				bounds.extend(primitiveBounds[p]);
+			}
+		} else {
+			bounds = m_nodes[i + 1].bounds;
+			bounds.extend(m_nodes[node.offset].bounds);
+		}
+		node.bounds = bounds;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+float BVH::cost() const
+{
+	if (m_nodes.empty()) {
+		return 0.0f;
+	}
+
+	float rootArea = m_nodes[0].bounds.surfaceArea();
+	if (rootArea <= 0.0f) {
+		return 0.0f;
+	}
+
+	float cost = 0.0f;
+	for (const BVHNode & node : m_nodes) {
+		float weight = node.count > 0 ? (float)node.count : SahTraversalCost;
+		cost += weight * node.bounds.surfaceArea() / rootArea;
+	}
+	return cost;
+}
+
+//---------------------------------------------------------------------------------------
+// Walks the subtree at index depth first, as build() emits it, and returns
+// the index just past it, or 0 if it is malformed.
+static size_t checkSubtree(const BVHNode * nodes, size_t count, size_t primitiveCount,
+	size_t index, int depth)
+{
+	if (index >= count || depth >= BVH::MaxDepth) {
+		return 0;
+	}
+
+	const BVHNode & node = nodes[index];
+	if (node.count > 0) {
+		return node.offset <= primitiveCount && node.count <= primitiveCount - node.offset
+			? index + 1 : 0;
+	}
+
+	// The first child follows its parent, the second follows the first's
+	// subtree.
+	if (node.axis > 2) {
+		return 0;
+	}
+	size_t second = checkSubtree(nodes, count, primitiveCount, index + 1, depth + 1);
+	if (second == 0 || node.offset != second) {
+		return 0;
+	}
+	return checkSubtree(nodes, count, primitiveCount, second, depth + 1);
+}
+
+//---------------------------------------------------------------------------------------
+bool BVH::assign(const BVHNode * nodes, size_t count, size_t primitiveCount)
+{
+	if (count > 0 && checkSubtree(nodes, count, primitiveCount, 0, 0) != count) {
+		return false;
+	}
+	m_nodes.assign(nodes, nodes + count);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+bool BVH::empty() const
+{
+	return m_nodes.empty();
+}
+
+//---------------------------------------------------------------------------------------
+AABB BVH::bounds() const
+{
+	return m_nodes.empty() ? AABB() : m_nodes[0].bounds;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<BVHNode> & BVH::nodes() const
+{
+	return m_nodes;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AABB.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "RenderStats.hpp"
+
+// One node of a flattened BVH. Nodes are stored depth first, so the first
+// child of an interior node always immediately follows it in the array.
+struct BVHNode {
+	AABB bounds;
+
+	// Leaf: index of the first primitive.
+	// Interior: index of the second child.
+	uint32_t offset;
+
+	// Number of primitives in a leaf, 0 for interior nodes.
+	uint16_t count;
+
+	// Axis the children were split along, used to visit the nearer child first.
+	uint16_t axis;
+};
+
+/**
+ * A bounding volume hierarchy built with the surface area heuristic.
+ *
+ * The BVH does not know what it contains: it is built from a list of
+ * primitive bounds, and build() returns the order in which the leaves
+ * reference those primitives. Callers reorder their own primitive arrays
+ * by that permutation so that a leaf covers a contiguous range of them.
+ */
+class BVH {
+public:
+	BVH();
+
+	// Build over the given primitive bounds, replacing any previous tree.
+	// Returns, for each leaf slot, the index of the primitive it refers to.
+	std::vector<uint32_t> build(const std::vector<AABB> & primitiveBounds,
+		uint32_t maxLeafSize = 4);
+
+	// Put every primitive in one leaf, so queries test them all in order.
+	// Only worth it for a handful of primitives; falls back to build() for
+	// more than a leaf can hold.
+	std::vector<uint32_t> buildLeaf(const std::vector<AABB> & primitiveBounds);
+
+	// Recompute every node's bounds for primitives that have moved, keeping
+	// the tree as it is. primitiveBounds are in build order, as the leaves
+	// reference them. Much cheaper than build(), but the tree gets worse
+	// the further things move from where they were when it was built.
+	void refit(const std::vector<AABB> & primitiveBounds);
+
+	// Expected cost of a ray query by the surface area heuristic, in
+	// primitive tests, for comparing a refitted tree with its build.
+	float cost() const;
+
+	// Replace the tree with nodes saved from an earlier build(), e.g. from
+	// nodes() of a BVH over the same primitives in the same order. Nodes
+	// from outside the program are checked first: every leaf must lie within
+	// primitiveCount, every subtree must be laid out as build() lays it out
+	// and no deeper than MaxDepth. Returns false, leaving the tree as it
+	// was, if they are not.
+	bool assign(const BVHNode * nodes, size_t count, size_t primitiveCount);
+
+	bool empty() const;
+
+	// Bounds of everything in the hierarchy.
+	AABB bounds() const;
+
+	const std::vector<BVHNode> & nodes() const;
+
+	// Find the closest hit along the ray. intersectPrimitive(i) is called for
+	// the i-th primitive (in build order) of every leaf the ray reaches; it
+	// must update hit when it finds something closer than hit.t and return
+	// whether it did.
+	//
+	// If stats is given, the nodes visited and primitives tested are added
+	// to it. Every traversal here takes one.
+	template <typename IntersectPrimitive>
+	bool intersect(const Ray & ray, float tMin, Intersection & hit,
+		IntersectPrimitive intersectPrimitive, TraceStats * stats = nullptr) const;
+
+	// As intersect(), but intersectLeaf(offset, count) is called once for
+	// each leaf reached, with its primitives [offset, offset + count), so
+	// that they can be tested together.
+	template <typename IntersectLeaf>
+	bool intersectLeaves(const Ray & ray, float tMin, Intersection & hit,
+		IntersectLeaf intersectLeaf, TraceStats * stats = nullptr) const;
+
+	// Any-hit query for shadow rays: whether occludes(i) is true for some
+	// primitive in a leaf the ray reaches between tMin and tMax. Traversal
+	// stops at the first one, which need not be the closest.
+	template <typename Occludes>
+	bool occluded(const Ray & ray, float tMin, float tMax, Occludes occludes,
+		TraceStats * stats = nullptr) const;
+
+	// As occluded(), with occludesLeaf(offset, count) called once per leaf
+	// as in intersectLeaves().
+	template <typename OccludesLeaf>
+	bool occludedLeaves(const Ray & ray, float tMin, float tMax, OccludesLeaf occludesLeaf,
+		TraceStats * stats = nullptr) const;
+
+	// Packet version of intersect(): intersectPrimitive(i) returns the lanes
+	// it updated, and is called whenever any active lane reaches a leaf.
+	// Returns the lanes that found a hit.
+	template <typename IntersectPrimitive>
+	simd::Mask intersect(const RayPacket & packet, float tMin, PacketIntersection & hit,
+		IntersectPrimitive intersectPrimitive, TraceStats * stats = nullptr) const;
+
+	// Deep enough for any tree the builder produces.
+	static const int MaxDepth = 64;
+
+private:
+	struct BuildItem {
+		AABB bounds;
+		glm::vec3 centroid;
+		uint32_t index;
+	};
+
+	uint32_t buildRecursive(std::vector<BuildItem> & items,
+		uint32_t begin, uint32_t end, int depth);
+
+	uint32_t m_maxLeafSize;
+	std::vector<BVHNode> m_nodes;
+};
+
+//---------------------------------------------------------------------------------------
+inline void recordTraversal(TraceStats * stats, uint64_t visits, uint64_t tests)
+{
+	if (stats) {
+		stats->nodeVisits += visits;
+		stats->primitiveTests += tests;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+template <typename IntersectPrimitive>
+bool BVH::intersect(const Ray & ray, float tMin, Intersection & hit,
+	IntersectPrimitive intersectPrimitive, TraceStats * stats) const
+{
+	return intersectLeaves(ray, tMin, hit, [&](uint32_t offset, uint32_t count) {
+		bool found = false;
+		for (uint32_t i = offset; i < offset + count; ++i) {
+			if (intersectPrimitive(i)) {
+				found = true;
+			}
+		}
+		return found;
+	}, stats);
+}
+
+//---------------------------------------------------------------------------------------
+template <typename IntersectLeaf>
+bool BVH::intersectLeaves(const Ray & ray, float tMin, Intersection & hit,
+	IntersectLeaf intersectLeaf, TraceStats * stats) const
+{
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	const bool directionNegative[3] = {
+		ray.invDirection.x < 0.0f,
+		ray.invDirection.y < 0.0f,
+		ray.invDirection.z < 0.0f
+	};
+
+	bool found = false;
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t current = 0;
+	uint64_t visits = 0;
+	uint64_t tests = 0;
+
+	for (;;) {
+		const BVHNode & node = m_nodes[current];
+		++visits;
+
+		if (node.bounds.intersect(ray, tMin, hit.t)) {
+			if (node.count > 0) {
+				tests += node.count;
+				if (intersectLeaf(node.offset, node.count)) {
+					found = true;
+				}
+			} else if (directionNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) {
+			break;
+		}
+		current = stack[--stackSize];
+	}
+
+	recordTraversal(stats, visits, tests);
+	return found;
+}
+
+//---------------------------------------------------------------------------------------
+template <typename Occludes>
+bool BVH::occluded(const Ray & ray, float tMin, float tMax, Occludes occludes,
+	TraceStats * stats) const
+{
+	return occludedLeaves(ray, tMin, tMax, [&](uint32_t offset, uint32_t count) {
+		for (uint32_t i = offset; i < offset + count; ++i) {
+			if (occludes(i)) {
+				return true;
+			}
+		}
+		return false;
+	}, stats);
+}
+
+//---------------------------------------------------------------------------------------
+template <typename OccludesLeaf>
+bool BVH::occludedLeaves(const Ray & ray, float tMin, float tMax, OccludesLeaf occludesLeaf,
+	TraceStats * stats) const
+{
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	// Any order finds an occluder if there is one; nearer first tends to
+	// find it sooner.
+	const bool directionNegative[3] = {
+		ray.invDirection.x < 0.0f,
+		ray.invDirection.y < 0.0f,
+		ray.invDirection.z < 0.0f
+	};
+
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t current = 0;
+	uint64_t visits = 0;
+	uint64_t tests = 0;
+
+	for (;;) {
+		const BVHNode & node = m_nodes[current];
+		++visits;
+
+		if (node.bounds.intersect(ray, tMin, tMax)) {
+			if (node.count > 0) {
+				tests += node.count;
+				if (occludesLeaf(node.offset, node.count)) {
+					recordTraversal(stats, visits, tests);
+					return true;
+				}
+			} else if (directionNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) {
+			break;
+		}
+		current = stack[--stackSize];
+	}
+
+	recordTraversal(stats, visits, tests);
+	return false;
+}
+
+//---------------------------------------------------------------------------------------
+template <typename IntersectPrimitive>
+simd::Mask BVH::intersect(const RayPacket & packet, float tMin, PacketIntersection & hit,
+	IntersectPrimitive intersectPrimitive, TraceStats * stats) const
+{
+	simd::Mask found = simd::andNot(packet.active, packet.active);
+	if (m_nodes.empty()) {
+		return found;
+	}
+
+	// Visit children in the order that suits most of the active rays.
+	int activeCount = 0;
+	int negativeCount[3] = { 0, 0, 0 };
+	int activeBits = simd::bits(packet.active);
+	int negativeBits[3] = {
+		simd::bits(packet.active & (packet.dx < simd::Float(0.0f))),
+		simd::bits(packet.active & (packet.dy < simd::Float(0.0f))),
+		simd::bits(packet.active & (packet.dz < simd::Float(0.0f)))
+	};
+	for (int lane = 0; lane < simd::Width; ++lane) {
+		activeCount += (activeBits >> lane) & 1;
+		for (int a = 0; a < 3; ++a) {
+			negativeCount[a] += (negativeBits[a] >> lane) & 1;
+		}
+	}
+	bool directionNegative[3];
+	for (int a = 0; a < 3; ++a) {
+		directionNegative[a] = 2 * negativeCount[a] > activeCount;
+	}
+
+	simd::Float packetTMin(tMin);
+	uint32_t stack[MaxDepth];
+	int stackSize = 0;
+	uint32_t current = 0;
+	uint64_t visits = 0;
+	uint64_t tests = 0;
+
+	for (;;) {
+		const BVHNode & node = m_nodes[current];
+		++visits;
+
+		if (simd::any(packet.intersect(node.bounds, packetTMin, hit.t))) {
+			if (node.count > 0) {
+				tests += node.count;
+				for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+					found = found | intersectPrimitive(i);
+				}
+			} else if (directionNegative[node.axis]) {
+				stack[stackSize++] = current + 1;
+				current = node.offset;
+				continue;
+			} else {
+				stack[stackSize++] = node.offset;
+				current = current + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0) {
+			break;
+		}
+		current = stack[--stackSize];
+	}
+
+	recordTraversal(stats, visits, tests);
+	return found;
+}
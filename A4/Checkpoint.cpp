@@ -0,0 +1,128 @@
+#include "Checkpoint.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char ResumeMagic[8] = { 'A', '4', 'R', 'E', 'S', 'U', 'M', 'E' };
+static const uint32_t ResumeVersion = 2;
+
+//---------------------------------------------------------------------------------------
+// Write through a temporary file and rename it over filename.
+template <typename Write>
+static bool replaceFile(const std::string & filename, Write write)
+{
+	std::string temporary = filename + ".tmp";
+	if (!write(temporary)) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	// rename() does not replace an existing file everywhere.
+	std::remove(filename.c_str());
+	return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+//---------------------------------------------------------------------------------------
+ResumeState::ResumeState()
+	: pass(0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+bool ResumeState::save(const std::string & filename) const
+{
+	return replaceFile(filename, [this](const std::string & path) {
+		std::ofstream out(path, std::ios::binary);
+		uint32_t header[6] = {
+			ResumeVersion, image.width(), image.height(), (uint32_t)image.format(),
+			pass, (uint32_t)tileDone.size()
+		};
+
+		out.write(ResumeMagic, sizeof(ResumeMagic));
+		out.write((const char *)header, sizeof(header));
+		out.write((const char *)tileDone.data(), tileDone.size());
+		out.write((const char *)image.rawData(), image.rawSize());
+		return bool(out);
+	});
+}
+
+//---------------------------------------------------------------------------------------
+bool ResumeState::load(const std::string & filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	char magic[sizeof(ResumeMagic)];
+	uint32_t header[6];
+
+	in.read(magic, sizeof(magic));
+	in.read((char *)header, sizeof(header));
+	if (!in || std::memcmp(magic, ResumeMagic, sizeof(magic)) != 0
+		|| header[0] != ResumeVersion || header[3] > (uint32_t)Image::Format::Half) {
+		return false;
+	}
+
+	std::vector<uint8_t> done(header[5]);
+	Image loaded(header[1], header[2], (Image::Format)header[3]);
+	in.read((char *)done.data(), done.size());
+	in.read((char *)loaded.rawData(), loaded.rawSize());
+	if (!in) {
+		return false;
+	}
+
+	pass = header[4];
+	tileDone.swap(done);
+	image = loaded;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+CheckpointWriter::CheckpointWriter(double intervalSeconds, const Checkpoint & checkpoint)
+	: m_checkpoint(checkpoint),
+	  m_stop(false),
+	  m_thread(&CheckpointWriter::run, this, intervalSeconds)
+{
+}
+
+//---------------------------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter()
+{
+	stop();
+}
+
+//---------------------------------------------------------------------------------------
+void CheckpointWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void CheckpointWriter::run(double intervalSeconds)
+{
+	auto interval = std::chrono::duration<double>(intervalSeconds);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_wake.wait_for(lock, interval, [this] { return m_stop; })) {
+		lock.unlock();
+		m_checkpoint();
+		lock.lock();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+bool saveCheckpointImage(const Image & image, const std::string & filename)
+{
+	// The temporary file's extension does not say what to write.
+	Image::FileType type = Image::fileType(filename);
+	return replaceFile(filename, [&image, type](const std::string & path) {
+		return image.save(path, type);
+	});
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Image.hpp"
+
+/**
+ * Everything needed to pick up an interrupted progressive render: the
+ * image so far, the pass in progress and which of its tiles are finished.
+ */
+struct ResumeState {
+	ResumeState();
+
+	// Write to filename, replacing it only once the new file is complete.
+	bool save(const std::string & filename) const;
+
+	// Read a state written by save(). Returns false, leaving this state
+	// untouched, if the file is missing or not a valid state.
+	bool load(const std::string & filename);
+
+	// Index of the first pass that is not finished.
+	uint pass;
+
+	// One flag per tile of that pass, set once the tile is finished.
+	std::vector<uint8_t> tileDone;
+
+	Image image;
+};
+
+/**
+ * Calls a checkpoint function at a fixed interval on a background thread,
+ * so saving does not hold up rendering, until stopped or destroyed.
+ */
+class CheckpointWriter {
+public:
+	typedef std::function<void()> Checkpoint;
+
+	CheckpointWriter(double intervalSeconds, const Checkpoint & checkpoint);
+
+	~CheckpointWriter();
+
+	// Stop the thread, waiting for a checkpoint in progress to finish.
+	void stop();
+
+private:
+	CheckpointWriter(const CheckpointWriter &) = delete;
+	CheckpointWriter & operator=(const CheckpointWriter &) = delete;
+
+	void run(double intervalSeconds);
+
+	Checkpoint m_checkpoint;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop;
+
+	std::thread m_thread;
+};
+
+// Save image in the format filename's extension calls for, writing to a
+// temporary file first so that filename is never left half written.
+bool saveCheckpointImage(const Image & image, const std::string & filename);
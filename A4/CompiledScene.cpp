@@ -0,0 +1,459 @@
+#include "CompiledScene.hpp"
+
+#include <iostream>
+
+#include "GeometryNode.hpp"
+#include "PhongMaterial.hpp"
+#include "Primitive.hpp"
+
+// Instances are big and few compared to triangles, so allow fewer per leaf.
+static const uint32_t InstancesPerLeaf = 2;
+
+// refit() rebuilds the BVH instead once refitting has made it this much
+// more expensive to traverse than when it was built.
+static const float RebuildCostRatio = 1.5f;
+
+const uint32_t CompiledScene::DefaultMaterial;
+const uint32_t CompiledScene::NoInstance;
+
+//---------------------------------------------------------------------------------------
+// World space bounds of an instance.
+static AABB worldBounds(const CompiledInstance & instance)
+{
+	AABB modelBounds;
+	switch (instance.type) {
+		case PrimitiveType::WorldSphere:
+			return AABB(instance.position - glm::vec3(instance.size),
+			            instance.position + glm::vec3(instance.size));
+		case PrimitiveType::WorldBox:
+			return AABB(instance.position, instance.position + glm::vec3(instance.size));
+		case PrimitiveType::Sphere:
+			modelBounds = AABB(instance.position - glm::vec3(instance.size),
+			                   instance.position + glm::vec3(instance.size));
+			break;
+		case PrimitiveType::Box:
+			modelBounds = AABB(instance.position,
+			                   instance.position + glm::vec3(instance.size));
+			break;
+		case PrimitiveType::Mesh:
+			modelBounds = instance.mesh->bounds();
+			break;
+	}
+	return modelBounds.transformed(glm::inverse(instance.worldToModel));
+}
+
+//---------------------------------------------------------------------------------------
+// Make a Sphere or Box instance a WorldSphere or WorldBox if its transform
+// is a translation and a uniform scale, when world = (model - t) / scale
+// takes its position and size to world space.
+static void foldIntoWorldSpace(CompiledInstance & instance)
+{
+	const glm::mat4 & m = instance.worldToModel;
+	float scale = m[0][0];
+	bool uniform = scale > 0.0f && m[1][1] == scale && m[2][2] == scale
+		&& m[0][1] == 0.0f && m[0][2] == 0.0f && m[0][3] == 0.0f
+		&& m[1][0] == 0.0f && m[1][2] == 0.0f && m[1][3] == 0.0f
+		&& m[2][0] == 0.0f && m[2][1] == 0.0f && m[2][3] == 0.0f
+		&& m[3][3] == 1.0f;
+	if (!uniform) {
+		return;
+	}
+
+	instance.position = (instance.position - glm::vec3(m[3])) / scale;
+	instance.size /= scale;
+	instance.radiusSquared = double(instance.size) * instance.size;
+	instance.type = instance.type == PrimitiveType::Sphere
+		? PrimitiveType::WorldSphere
+		: PrimitiveType::WorldBox;
+}
+
+//---------------------------------------------------------------------------------------
+// Intersect an instance that is tested in its model space, taking the ray
+// there and the normal of a hit back.
+static bool intersectModel(const CompiledInstance & instance, const Ray & ray, float tMin,
+	Intersection & hit, TraceStats * stats)
+{
+	const glm::mat4 & m = instance.worldToModel;
+	Ray local(glm::vec3(m * glm::vec4(ray.origin, 1.0f)),
+	          glm::vec3(m * glm::vec4(ray.direction, 0.0f)));
+
+	bool found = false;
+	switch (instance.type) {
+		case PrimitiveType::Sphere:
+			found = intersectSphere(local, instance.position, instance.size, tMin, hit);
+			break;
+		case PrimitiveType::Box:
+			found = intersectBox(local, instance.position,
+				instance.position + glm::vec3(instance.size), tMin, hit);
+			break;
+		case PrimitiveType::Mesh:
+			found = instance.mesh->intersect(local, tMin, hit, stats);
+			break;
+		default:
+			break;
+	}
+
+	if (found) {
+		hit.normal = instance.normalToWorld * hit.normal;
+	}
+	return found;
+}
+
+//---------------------------------------------------------------------------------------
+// Packet version of intersectModel().
+static simd::Mask intersectModel(const CompiledInstance & instance, const RayPacket & packet,
+	float tMin, PacketIntersection & hit, TraceStats * stats)
+{
+	RayPacket local = packet.transformed(instance.worldToModel);
+
+	simd::Mask found;
+	switch (instance.type) {
+		case PrimitiveType::Sphere:
+			found = intersectSphere(local, instance.position, instance.size, tMin, hit);
+			break;
+		case PrimitiveType::Box:
+			found = intersectBox(local, instance.position,
+				instance.position + glm::vec3(instance.size), tMin, hit);
+			break;
+		case PrimitiveType::Mesh:
+			found = instance.mesh->intersect(local, tMin, hit, stats);
+			break;
+		default:
+			break;
+	}
+
+	if (simd::none(found)) {
+		return found;
+	}
+
+	const glm::mat3 & n = instance.normalToWorld;
+	simd::Float nx = simd::Float(n[0][0]) * hit.nx + simd::Float(n[1][0]) * hit.ny + simd::Float(n[2][0]) * hit.nz;
+	simd::Float ny = simd::Float(n[0][1]) * hit.nx + simd::Float(n[1][1]) * hit.ny + simd::Float(n[2][1]) * hit.nz;
+	simd::Float nz = simd::Float(n[0][2]) * hit.nx + simd::Float(n[1][2]) * hit.ny + simd::Float(n[2][2]) * hit.nz;
+	hit.nx = simd::select(found, nx, hit.nx);
+	hit.ny = simd::select(found, ny, hit.ny);
+	hit.nz = simd::select(found, nz, hit.nz);
+	return found;
+}
+
+//---------------------------------------------------------------------------------------
+static std::vector<AABB> worldBounds(const std::vector<CompiledInstance> & instances)
+{
+	std::vector<AABB> bounds;
+	bounds.reserve(instances.size());
+	for (const CompiledInstance & instance : instances) {
+		bounds.push_back(worldBounds(instance));
+	}
+	return bounds;
+}
+
+//---------------------------------------------------------------------------------------
+CompiledScene::CompiledScene(const SceneNode * root, Acceleration acceleration)
+	: m_acceleration(acceleration),
+	  m_builtCost(0.0f)
+{
+	CompiledMaterial defaultMaterial;
+	defaultMaterial.kd = glm::vec3(0.5f);
+	defaultMaterial.ks = glm::vec3(0.0f);
+	defaultMaterial.shininess = 0.0f;
+	defaultMaterial.reflectivity = 0.0f;
+	defaultMaterial.transparency = 0.0f;
+	defaultMaterial.refractiveIndex = 1.0f;
+	m_materials.push_back(defaultMaterial);
+
+	compile(root, glm::mat4(), m_instances);
+	build();
+}
+
+//---------------------------------------------------------------------------------------
+bool CompiledScene::refit(const SceneNode * root)
+{
+	std::vector<CompiledInstance> instances;
+	compile(root, glm::mat4(), instances);
+
+	if (instances.size() == m_order.size()) {
+		for (size_t i = 0; i < m_order.size(); ++i) {
+			m_instances[i] = instances[m_order[i]];
+		}
+		m_bvh.refit(worldBounds(m_instances));
+
+		if (m_bvh.cost() <= RebuildCostRatio * m_builtCost) {
+			return true;
+		}
+	}
+
+	m_instances.swap(instances);
+	build();
+	return false;
+}
+
+//---------------------------------------------------------------------------------------
+void CompiledScene::build()
+{
+	std::vector<AABB> bounds = worldBounds(m_instances);
+	m_order = m_acceleration == Acceleration::None
+		? m_bvh.buildLeaf(bounds)
+		: m_bvh.build(bounds, InstancesPerLeaf);
+	m_builtCost = m_bvh.cost();
+
+	std::vector<CompiledInstance> instances;
+	instances.reserve(m_instances.size());
+	for (uint32_t index : m_order) {
+		instances.push_back(m_instances[index]);
+	}
+	m_instances.swap(instances);
+}
+
+//---------------------------------------------------------------------------------------
+void CompiledScene::compile(const SceneNode * node, const glm::mat4 & parentWorldToModel,
+	std::vector<CompiledInstance> & instances)
+{
+	glm::mat4 worldToModel = node->get_inverse() * parentWorldToModel;
+
+	if (node->m_nodeType == NodeType::GeometryNode) {
+		const GeometryNode * geometry = static_cast<const GeometryNode *>(node);
+		const Primitive * primitive = geometry->m_primitive.get();
+
+		CompiledInstance instance;
+		instance.worldToModel = worldToModel;
+		instance.normalToWorld = glm::transpose(glm::mat3(worldToModel));
+		instance.position = glm::vec3(0.0f);
+		instance.size = 1.0f;
+		instance.radiusSquared = 1.0;
+		instance.mesh = nullptr;
+		instance.material = materialIndex(geometry->m_material);
+
+		bool supported = true;
+		if (const NonhierSphere * sphere = dynamic_cast<const NonhierSphere *>(primitive)) {
+			instance.type = PrimitiveType::Sphere;
+			instance.position = sphere->position();
+			instance.size = float(sphere->radius());
+		} else if (const NonhierBox * box = dynamic_cast<const NonhierBox *>(primitive)) {
+			instance.type = PrimitiveType::Box;
+			instance.position = box->position();
+			instance.size = float(box->size());
+		} else if (const Mesh * mesh = dynamic_cast<const Mesh *>(primitive)) {
+			instance.type = PrimitiveType::Mesh;
+			instance.mesh = mesh;
+			// E.g. one that failed to load. Its empty bounds would poison
+			// the scene BVH.
+			supported = !mesh->bounds().empty();
+		} else if (dynamic_cast<const Sphere *>(primitive)) {
+			instance.type = PrimitiveType::Sphere;
+		} else if (dynamic_cast<const Cube *>(primitive)) {
+			instance.type = PrimitiveType::Box;
+		} else {
+			std::cerr << "Skipping node " << node->m_name
+			          << ": unknown primitive type" << std::endl;
+			supported = false;
+		}
+
+		if (supported) {
+			if (instance.type != PrimitiveType::Mesh) {
+				foldIntoWorldSpace(instance);
+			}
+			instances.push_back(instance);
+		}
+	}
+
+	for (const SceneNode * child : node->children) {
+		compile(child, worldToModel, instances);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+uint32_t CompiledScene::materialIndex(const Material * material)
+{
+	const PhongMaterial * phong = dynamic_cast<const PhongMaterial *>(material);
+	if (!phong) {
+		return DefaultMaterial;
+	}
+
+	auto i = m_materialIndices.find(material);
+	if (i != m_materialIndices.end()) {
+		return i->second;
+	}
+
+	CompiledMaterial compiled;
+	compiled.kd = phong->kd();
+	compiled.ks = phong->ks();
+	compiled.shininess = float(phong->shininess());
+	compiled.reflectivity = float(phong->reflectivity());
+	compiled.transparency = float(phong->transparency());
+	compiled.refractiveIndex = float(phong->refractiveIndex());
+
+	uint32_t index = (uint32_t)m_materials.size();
+	m_materials.push_back(compiled);
+	m_materialIndices[material] = index;
+	return index;
+}
+
+//---------------------------------------------------------------------------------------
+bool CompiledScene::intersect(const Ray & ray, float tMin, Intersection & hit,
+	TraceStats * stats) const
+{
+	return m_bvh.intersect(ray, tMin, hit, [&](uint32_t i) {
+		const CompiledInstance & instance = m_instances[i];
+
+		bool found;
+		switch (instance.type) {
+			case PrimitiveType::WorldSphere:
+				found = intersectSphereSquared(ray, instance.position, instance.radiusSquared,
+					tMin, hit);
+				break;
+			case PrimitiveType::WorldBox:
+				found = intersectBox(ray, instance.position,
+					instance.position + glm::vec3(instance.size), tMin, hit);
+				break;
+			default:
+				found = intersectModel(instance, ray, tMin, hit, stats);
+				break;
+		}
+
+		if (found) {
+			hit.material = instance.material;
+		}
+		return found;
+	}, stats);
+}
+
+//---------------------------------------------------------------------------------------
+uint32_t CompiledScene::findOccluder(const Ray & ray, float tMin, float tMax,
+	TraceStats * stats) const
+{
+	uint32_t occluder = NoInstance;
+	m_bvh.occluded(ray, tMin, tMax, [&](uint32_t i) {
+		if (occludes(i, ray, tMin, tMax, stats)) {
+			occluder = i;
+			return true;
+		}
+		return false;
+	}, stats);
+	return occluder;
+}
+
+//---------------------------------------------------------------------------------------
+bool CompiledScene::occludes(uint32_t index, const Ray & ray, float tMin, float tMax,
+	TraceStats * stats) const
+{
+	const CompiledInstance & instance = m_instances[index];
+	Intersection hit(tMax);
+	switch (instance.type) {
+		case PrimitiveType::WorldSphere:
+			return intersectSphereSquared(ray, instance.position, instance.radiusSquared,
+				tMin, hit);
+		case PrimitiveType::WorldBox:
+			return intersectBox(ray, instance.position,
+				instance.position + glm::vec3(instance.size), tMin, hit);
+		default:
+			break;
+	}
+
+	const glm::mat4 & m = instance.worldToModel;
+	Ray local(glm::vec3(m * glm::vec4(ray.origin, 1.0f)),
+	          glm::vec3(m * glm::vec4(ray.direction, 0.0f)));
+	switch (instance.type) {
+		case PrimitiveType::Sphere:
+			return intersectSphere(local, instance.position, instance.size, tMin, hit);
+		case PrimitiveType::Box:
+			return intersectBox(local, instance.position,
+				instance.position + glm::vec3(instance.size), tMin, hit);
+		case PrimitiveType::Mesh:
+			return instance.mesh->occluded(local, tMin, tMax, stats);
+		default:
+			break;
+	}
+	return false;
+}
+
+//---------------------------------------------------------------------------------------
+simd::Mask CompiledScene::intersect(const RayPacket & packet, float tMin, PacketIntersection & hit,
+	TraceStats * stats) const
+{
+	return m_bvh.intersect(packet, tMin, hit, [&](uint32_t i) {
+		const CompiledInstance & instance = m_instances[i];
+
+		simd::Mask found;
+		switch (instance.type) {
+			case PrimitiveType::WorldSphere:
+				found = intersectSphere(packet, instance.position, instance.size, tMin, hit);
+				break;
+			case PrimitiveType::WorldBox:
+				found = intersectBox(packet, instance.position,
+					instance.position + glm::vec3(instance.size), tMin, hit);
+				break;
+			default:
+				found = intersectModel(instance, packet, tMin, hit, stats);
+				break;
+		}
+
+		int foundBits = simd::bits(found);
+		for (int lane = 0; lane < simd::Width; ++lane) {
+			if (foundBits & (1 << lane)) {
+				hit.material[lane] = instance.material;
+			}
+		}
+		return found;
+	}, stats);
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<CompiledInstance> & CompiledScene::instances() const
+{
+	return m_instances;
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<CompiledMaterial> & CompiledScene::materials() const
+{
+	return m_materials;
+}
+
+//---------------------------------------------------------------------------------------
+AABB CompiledScene::bounds() const
+{
+	return m_bvh.bounds();
+}
+
+//---------------------------------------------------------------------------------------
+std::ostream & operator << (std::ostream & os, const CompiledScene & scene)
+{
+	os << "CompiledScene:[";
+	os << "instances:" << scene.m_instances.size() << ", ";
+	os << "materials:" << scene.m_materials.size();
+	os << "]\n";
+	return os;
+}
+
+//---------------------------------------------------------------------------------------
+ShadowCache::ShadowCache(size_t lightCount)
+	: lastOccluder(lightCount, CompiledScene::NoInstance)
+{
+}
+
+//---------------------------------------------------------------------------------------
+bool ShadowCache::occluded(const CompiledScene & scene, size_t light, const Ray & ray, float tMax,
+	TraceStats & stats)
+{
+	++stats.shadowRays;
+
+	uint32_t & last = lastOccluder[light];
+	if (last != CompiledScene::NoInstance) {
+		++stats.primitiveTests;
+		if (scene.occludes(last, ray, 0.0f, tMax, &stats)) {
+			++stats.shadowOccluded;
+			++stats.shadowCacheHits;
+			return true;
+		}
+	}
+
+	// The last occluder is kept on a miss: the ray may just have passed
+	// its edge, and it is cheap to try again.
+	uint32_t occluder = scene.findOccluder(ray, 0.0f, tMax, &stats);
+	if (occluder == CompiledScene::NoInstance) {
+		return false;
+	}
+	last = occluder;
+	++stats.shadowOccluded;
+	return true;
+}
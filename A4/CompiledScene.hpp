@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "BVH.hpp"
+#include "Material.hpp"
+#include "Mesh.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "SceneNode.hpp"
+
+// What CompiledScene builds over the instances: a BVH, or nothing, testing
+// every instance against every ray, which can win for a handful of them.
+enum class Acceleration : uint8_t {
+	Bvh,
+	None
+};
+
+// What an instance is, so intersection can switch on a tag instead of
+// going through Primitive's virtual functions.
+enum class PrimitiveType : uint8_t {
+	Sphere,
+	Box,
+	Mesh,
+	// A sphere or box whose transform is only a translation and a uniform
+	// scale, e.g. a NonhierSphere or NonhierBox under untransformed nodes.
+	// Its position and size are folded into world space when compiling,
+	// and rays test it as they are, with no matrix products either way.
+	WorldSphere,
+	WorldBox
+};
+
+// A GeometryNode placed in the world by the product of every transform on
+// the path to it from the root. A node reachable along several paths
+// (e.g. an arc added under six parents) gets one instance per path.
+struct CompiledInstance {
+	glm::mat4 worldToModel;
+
+	// Takes model space normals to world space: the transpose of the
+	// upper 3x3 of worldToModel.
+	glm::mat3 normalToWorld;
+
+	// Sphere: centre and radius. Box: minimum corner and edge length.
+	// Both in model space, so Sphere and Cube are the unit cases, and in
+	// world space for WorldSphere and WorldBox.
+	glm::vec3 position;
+	float size;
+
+	// WorldSphere only: size * size.
+	double radiusSquared;
+
+	// Set for PrimitiveType::Mesh only.
+	const Mesh * mesh;
+
+	PrimitiveType type;
+
+	// Index into CompiledScene's materials.
+	uint32_t material;
+};
+
+// The shading parameters of a PhongMaterial.
+struct CompiledMaterial {
+	glm::vec3 kd;
+	glm::vec3 ks;
+	float shininess;
+	float reflectivity;
+	float transparency;
+	float refractiveIndex;
+};
+
+class CompiledScene;
+
+// One thread's memory of which instance last blocked a shadow ray towards
+// each light. Neighbouring shading points are usually shadowed by the same
+// object, so trying it first often settles a shadow ray without walking
+// the BVH at all.
+struct ShadowCache {
+	explicit ShadowCache(size_t lightCount = 0);
+
+	// Whether the segment from ray.origin to ray.origin + tMax * direction
+	// is blocked, trying the last occluder of light first.
+	bool occluded(const CompiledScene & scene, size_t light, const Ray & ray, float tMax,
+		TraceStats & stats);
+
+	std::vector<uint32_t> lastOccluder;
+};
+
+/**
+ * A render-ready copy of a SceneNode hierarchy.
+ *
+ * Compiling walks the tree once, composing transforms on the way down, and
+ * produces a contiguous array of instances and materials plus a BVH over
+ * the instances' world space bounds (the top level of a two-level
+ * structure; each Mesh keeps its own BVH as the bottom level). Rendering
+ * only reads this form: no pointer chasing through children lists and no
+ * matrix products per ray beyond the one into the instance's model space,
+ * and none at all for spheres and boxes that only move and scale.
+ *
+ * Meshes are referenced, not copied, so the scene graph that was compiled
+ * must outlive the CompiledScene.
+ */
+class CompiledScene {
+public:
+	explicit CompiledScene(const SceneNode * root,
+		Acceleration acceleration = Acceleration::Bvh);
+
+	// Compile root again after its transforms have changed, e.g. between
+	// frames of an animation. With the same instances as before the BVH is
+	// refitted to their new bounds rather than rebuilt, unless that makes
+	// it much worse. Returns whether it was refitted.
+	bool refit(const SceneNode * root);
+
+	// Find the closest hit along a world space ray. On success hit.normal is
+	// in world space and hit.material is set. Queries count the BVH nodes
+	// and primitives they test into stats, if given.
+	bool intersect(const Ray & ray, float tMin, Intersection & hit,
+		TraceStats * stats = nullptr) const;
+
+	// Index of an instance hit along the ray between tMin and tMax, or
+	// NoInstance. Stops at the first hit found, for shadow rays.
+	uint32_t findOccluder(const Ray & ray, float tMin, float tMax,
+		TraceStats * stats = nullptr) const;
+
+	// Whether the given instance is hit along the ray between tMin and tMax.
+	bool occludes(uint32_t instance, const Ray & ray, float tMin, float tMax,
+		TraceStats * stats = nullptr) const;
+
+	// Packet version of intersect(). Returns the lanes that found a hit.
+	simd::Mask intersect(const RayPacket & packet, float tMin, PacketIntersection & hit,
+		TraceStats * stats = nullptr) const;
+
+	const std::vector<CompiledInstance> & instances() const;
+	const std::vector<CompiledMaterial> & materials() const;
+
+	// World space bounds of the whole scene.
+	AABB bounds() const;
+
+	// Index of the material used by geometry that was never given one.
+	static const uint32_t DefaultMaterial = 0;
+
+	static const uint32_t NoInstance = UINT32_MAX;
+
+	friend std::ostream & operator << (std::ostream & os, const CompiledScene & scene);
+
+private:
+	void compile(const SceneNode * node, const glm::mat4 & parentWorldToModel,
+		std::vector<CompiledInstance> & instances);
+	uint32_t materialIndex(const Material * material);
+
+	// Build the BVH over m_instances and put them in its order.
+	void build();
+
+	std::vector<CompiledInstance> m_instances;
+	std::vector<CompiledMaterial> m_materials;
+
+	// Gives each Material one index, in refit() too.
+	std::map<const Material *, uint32_t> m_materialIndices;
+
+	BVH m_bvh;
+	Acceleration m_acceleration;
+
+	// Instance i is the m_order[i]-th that compile() found.
+	std::vector<uint32_t> m_order;
+
+	// m_bvh.cost() when it was last built.
+	float m_builtCost;
+};
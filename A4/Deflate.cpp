@@ -0,0 +1,522 @@
+#include "Deflate.hpp"
+
+#include <algorithm>
+#include <queue>
+
+static const size_t WindowSize = 32768;
+static const size_t MinMatch = 3;
+static const size_t MaxMatch = 258;
+static const int HashBits = 15;
+
+// How many earlier positions to try before settling for the best match so
+// far; longer chains compress a little better and run slower.
+static const int MaxChain = 32;
+
+// Output is handed on in pieces of about this size.
+static const size_t OutputChunk = 1 << 16;
+
+// Literals and matches per block. Each block pays for its own code tables
+// (up to a few hundred bits) but gets codes fitted to its own contents.
+static const size_t BlockSymbols = 1 << 15;
+
+// Literal/length codes including the two reserved ones, which are never
+// used but make the canonical code for the fixed lengths the fixed code.
+static const int LiteralCodes = 288;
+static const int DistanceCodes = 30;
+static const int EndOfBlock = 256;
+static const int MaxCodeBits = 15;
+static const int MaxLengthCodeBits = 7;
+
+// The order code length code lengths are sent in.
+static const uint8_t LengthCodeOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static const uint16_t LengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DistanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DistanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+//---------------------------------------------------------------------------------------
+static uint32_t hash3(const unsigned char * p)
+{
+	uint32_t v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+	return (v * 2654435761u) >> (32 - HashBits);
+}
+
+//---------------------------------------------------------------------------------------
+static int lengthCode(unsigned length)
+{
+	return int(std::upper_bound(LengthBase, LengthBase + 29, length) - LengthBase) - 1;
+}
+
+//---------------------------------------------------------------------------------------
+static int distanceCode(unsigned distance)
+{
+	return int(std::upper_bound(DistanceBase, DistanceBase + 30, distance) - DistanceBase) - 1;
+}
+
+//---------------------------------------------------------------------------------------
+// Huffman code lengths for count symbols with the given frequencies, none
+// longer than maxBits. Where the optimal code is too deep the frequencies
+// are flattened and it is built again, as zlib's predecessors did. At least
+// two symbols always get a code, which some decoders insist on.
+static void huffmanLengths(const uint32_t * frequencies, int count, int maxBits,
+	uint8_t * lengths)
+{
+	std::vector<uint64_t> weights(frequencies, frequencies + count);
+	int used = 0;
+	for (int i = 0; i < count; ++i) {
+		used += weights[i] > 0;
+	}
+	for (int i = 0; i < count && used < 2; ++i) {
+		if (weights[i] == 0) {
+			weights[i] = 1;
+			++used;
+		}
+	}
+
+	typedef std::pair<uint64_t, int> Node;
+	std::vector<int> parent(2 * count);
+	for (;;) {
+		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+		for (int i = 0; i < count; ++i) {
+			if (weights[i] > 0) {
+				queue.push(Node(weights[i], i));
+			}
+		}
+
+		int next = count;
+		while (queue.size() > 1) {
+			Node a = queue.top();
+			queue.pop();
+			Node b = queue.top();
+			queue.pop();
+			parent[a.second] = next;
+			parent[b.second] = next;
+			queue.push(Node(a.first + b.first, next++));
+		}
+		int root = next - 1;
+
+		int deepest = 0;
+		for (int i = 0; i < count; ++i) {
+			int depth = 0;
+			if (weights[i] > 0) {
+				for (int node = i; node != root; node = parent[node]) {
+					++depth;
+				}
+			}
+			lengths[i] = (uint8_t)depth;
+			deepest = std::max(deepest, depth);
+		}
+		if (deepest <= maxBits) {
+			return;
+		}
+
+		for (uint64_t & weight : weights) {
+			weight = weight > 0 ? (weight >> 1) | 1 : 0;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// The canonical code for each symbol given every symbol's code length.
+static void canonicalCodes(const uint8_t * lengths, int count, uint16_t * codes)
+{
+	int lengthCount[MaxCodeBits + 1] = { 0 };
+	for (int i = 0; i < count; ++i) {
+		++lengthCount[lengths[i]];
+	}
+	lengthCount[0] = 0;
+
+	int nextCode[MaxCodeBits + 1] = { 0 };
+	int code = 0;
+	for (int bits = 1; bits <= MaxCodeBits; ++bits) {
+		code = (code + lengthCount[bits - 1]) << 1;
+		nextCode[bits] = code;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		codes[i] = lengths[i] ? (uint16_t)nextCode[lengths[i]]++ : 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+DeflateStream::DeflateStream(const Output & output, Framing framing)
+	: m_output(output),
+	  m_framing(framing),
+	  m_base(0),
+	  m_position(0),
+	  m_head(size_t(1) << HashBits, 0),
+	  m_previous(WindowSize, 0),
+	  m_bits(0),
+	  m_bitCount(0),
+	  m_adlerA(1),
+	  m_adlerB(0),
+	  m_finished(false)
+{
+	if (m_framing == Framing::Zlib) {
+		// zlib header: deflate with a 32 KB window, no dictionary.
+		m_pending.push_back(0x78);
+		m_pending.push_back(0x01);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::write(const unsigned char * data, size_t size)
+{
+	// Adler-32, reducing often enough that the sums cannot overflow.
+	const uint32_t Modulus = 65521;
+	for (size_t done = 0; done < size; ) {
+		size_t n = std::min<size_t>(size - done, 5552);
+		for (size_t i = 0; i < n; ++i) {
+			m_adlerA += data[done + i];
+			m_adlerB += m_adlerA;
+		}
+		m_adlerA %= Modulus;
+		m_adlerB %= Modulus;
+		done += n;
+	}
+
+	m_buffer.insert(m_buffer.end(), data, data + size);
+	if (m_buffer.size() - m_position >= 4 * WindowSize) {
+		compress(false);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::finish(bool last)
+{
+	if (m_finished) {
+		return;
+	}
+	m_finished = true;
+
+	compress(true);
+
+	bool final = last || m_framing == Framing::Zlib;
+	if (final || !m_symbols.empty()) {
+		writeBlock(final);
+	}
+	if (!final) {
+		// An empty stored block: its length fields start on a byte boundary.
+		putBits(0, 1);
+		putBits(0, 2);
+	}
+	if (m_bitCount > 0) {
+		putBits(0, 8 - m_bitCount);
+	}
+	if (!final) {
+		const unsigned char Empty[4] = { 0x00, 0x00, 0xff, 0xff };
+		m_pending.insert(m_pending.end(), Empty, Empty + 4);
+	}
+
+	if (m_framing == Framing::Zlib) {
+		uint32_t adler = adler32();
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			m_pending.push_back((unsigned char)(adler >> shift));
+		}
+	}
+	flushOutput();
+}
+
+//---------------------------------------------------------------------------------------
+uint32_t DeflateStream::adler32() const
+{
+	return (m_adlerB << 16) | m_adlerA;
+}
+
+//---------------------------------------------------------------------------------------
+// As zlib's adler32_combine: every byte of the second piece adds the first
+// piece's A sum to B once more.
+uint32_t DeflateStream::combineAdler32(uint32_t first, uint32_t second, uint64_t secondLength)
+{
+	const uint64_t Modulus = 65521;
+	uint64_t length = secondLength % Modulus;
+	uint64_t firstA = first & 0xffff;
+	uint64_t firstB = first >> 16;
+
+	uint64_t a = (firstA + (second & 0xffff) + Modulus - 1) % Modulus;
+	uint64_t b = (length * firstA + firstB + (second >> 16) + Modulus - length) % Modulus;
+	return uint32_t((b << 16) | a);
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::insertHash(size_t position)
+{
+	uint32_t h = hash3(&m_buffer[position]);
+	uint64_t absolute = m_base + position;
+	m_previous[absolute % WindowSize] = m_head[h];
+	m_head[h] = absolute + 1;
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::compress(bool final)
+{
+	size_t end = m_buffer.size();
+	size_t limit = final ? end : (end > MaxMatch ? end - MaxMatch : 0);
+
+	while (m_position < limit) {
+		size_t available = std::min(MaxMatch, end - m_position);
+		size_t bestLength = 0;
+		size_t bestDistance = 0;
+
+		if (available >= MinMatch) {
+			uint64_t current = m_base + m_position;
+			uint64_t candidate = m_head[hash3(&m_buffer[m_position])];
+			const unsigned char * here = &m_buffer[m_position];
+
+			for (int chain = 0; chain < MaxChain && candidate > 0; ++chain) {
+				uint64_t match = candidate - 1;
+				if (match >= current || current - match > WindowSize || match < m_base) {
+					break;
+				}
+
+				const unsigned char * there = &m_buffer[match - m_base];
+				if (there[bestLength] == here[bestLength]) {
+					size_t length = 0;
+					while (length < available && there[length] == here[length]) {
+						++length;
+					}
+					if (length > bestLength) {
+						bestLength = length;
+						bestDistance = size_t(current - match);
+						if (length == available) {
+							break;
+						}
+					}
+				}
+
+				uint64_t next = m_previous[match % WindowSize];
+				if (next >= candidate) {
+					break;
+				}
+				candidate = next;
+			}
+		}
+
+		size_t advance = 1;
+		if (bestLength >= MinMatch) {
+			m_symbols.push_back(Symbol{ (uint16_t)bestLength, (uint16_t)bestDistance });
+			advance = bestLength;
+		} else {
+			m_symbols.push_back(Symbol{ m_buffer[m_position], 0 });
+		}
+
+		for (size_t i = 0; i < advance; ++i, ++m_position) {
+			if (m_position + MinMatch <= end) {
+				insertHash(m_position);
+			}
+		}
+
+		if (m_symbols.size() >= BlockSymbols) {
+			writeBlock(false);
+		}
+	}
+
+	// Drop history that can no longer be referred to.
+	if (m_position > 2 * WindowSize) {
+		size_t drop = m_position - WindowSize;
+		m_buffer.erase(m_buffer.begin(), m_buffer.begin() + drop);
+		m_base += drop;
+		m_position -= drop;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::putBits(uint32_t bits, int count)
+{
+	m_bits |= uint64_t(bits) << m_bitCount;
+	m_bitCount += count;
+	while (m_bitCount >= 8) {
+		m_pending.push_back((unsigned char)m_bits);
+		m_bits >>= 8;
+		m_bitCount -= 8;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// Huffman codes are defined most significant bit first, the opposite of
+// every other field.
+void DeflateStream::putHuffman(uint32_t code, int length)
+{
+	uint32_t reversed = 0;
+	for (int i = 0; i < length; ++i) {
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	putBits(reversed, length);
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::writeBlock(bool final)
+{
+	uint32_t literalFrequencies[LiteralCodes] = { 0 };
+	uint32_t distanceFrequencies[DistanceCodes] = { 0 };
+	for (const Symbol & symbol : m_symbols) {
+		if (symbol.distance == 0) {
+			++literalFrequencies[symbol.value];
+		} else {
+			++literalFrequencies[257 + lengthCode(symbol.value)];
+			++distanceFrequencies[distanceCode(symbol.distance)];
+		}
+	}
+	literalFrequencies[EndOfBlock] = 1;
+
+	// The fixed code, and one built for this block.
+	uint8_t fixedLengths[LiteralCodes + DistanceCodes];
+	for (int i = 0; i < LiteralCodes; ++i) {
+		fixedLengths[i] = i < 144 ? 8 : (i < 256 ? 9 : (i < 280 ? 7 : 8));
+	}
+	std::fill(fixedLengths + LiteralCodes, fixedLengths + LiteralCodes + DistanceCodes, 5);
+
+	uint8_t lengths[LiteralCodes + DistanceCodes];
+	huffmanLengths(literalFrequencies, LiteralCodes, MaxCodeBits, lengths);
+	huffmanLengths(distanceFrequencies, DistanceCodes, MaxCodeBits, lengths + LiteralCodes);
+
+	int literalCount = LiteralCodes;
+	while (literalCount > 257 && lengths[literalCount - 1] == 0) {
+		--literalCount;
+	}
+	int distanceCount = DistanceCodes;
+	while (distanceCount > 1 && lengths[LiteralCodes + distanceCount - 1] == 0) {
+		--distanceCount;
+	}
+
+	// Both sets of code lengths are sent as one run length coded sequence:
+	// 16 repeats the previous length 3-6 times, 17 and 18 give 3-10 and
+	// 11-138 zeros.
+	struct Token {
+		uint8_t symbol;
+		uint8_t extra;
+		uint8_t extraBits;
+	};
+	std::vector<uint8_t> sequence(lengths, lengths + literalCount);
+	sequence.insert(sequence.end(), lengths + LiteralCodes, lengths + LiteralCodes + distanceCount);
+	std::vector<Token> tokens;
+	for (size_t i = 0; i < sequence.size(); ) {
+		uint8_t length = sequence[i];
+		size_t run = 1;
+		while (i + run < sequence.size() && sequence[i + run] == length) {
+			++run;
+		}
+
+		size_t done = 0;
+		if (length == 0) {
+			while (run - done >= 11) {
+				size_t n = std::min<size_t>(run - done, 138);
+				tokens.push_back(Token{ 18, uint8_t(n - 11), 7 });
+				done += n;
+			}
+			if (run - done >= 3) {
+				tokens.push_back(Token{ 17, uint8_t(run - done - 3), 3 });
+				done = run;
+			}
+		} else {
+			tokens.push_back(Token{ length, 0, 0 });
+			done = 1;
+			while (run - done >= 3) {
+				size_t n = std::min<size_t>(run - done, 6);
+				tokens.push_back(Token{ 16, uint8_t(n - 3), 2 });
+				done += n;
+			}
+		}
+		for (; done < run; ++done) {
+			tokens.push_back(Token{ length, 0, 0 });
+		}
+		i += run;
+	}
+
+	uint32_t tokenFrequencies[19] = { 0 };
+	for (const Token & token : tokens) {
+		++tokenFrequencies[token.symbol];
+	}
+	uint8_t tokenLengths[19];
+	huffmanLengths(tokenFrequencies, 19, MaxLengthCodeBits, tokenLengths);
+	int tokenLengthCount = 19;
+	while (tokenLengthCount > 4 && tokenLengths[LengthCodeOrder[tokenLengthCount - 1]] == 0) {
+		--tokenLengthCount;
+	}
+
+	// Extra bits cost the same either way, so only the codes are compared.
+	uint64_t fixedBits = 0;
+	uint64_t dynamicBits = 5 + 5 + 4 + 3 * uint64_t(tokenLengthCount);
+	for (const Token & token : tokens) {
+		dynamicBits += tokenLengths[token.symbol] + token.extraBits;
+	}
+	for (int i = 0; i < LiteralCodes; ++i) {
+		fixedBits += uint64_t(literalFrequencies[i]) * fixedLengths[i];
+		dynamicBits += uint64_t(literalFrequencies[i]) * lengths[i];
+	}
+	for (int i = 0; i < DistanceCodes; ++i) {
+		fixedBits += uint64_t(distanceFrequencies[i]) * fixedLengths[LiteralCodes + i];
+		dynamicBits += uint64_t(distanceFrequencies[i]) * lengths[LiteralCodes + i];
+	}
+
+	bool dynamic = dynamicBits < fixedBits;
+	const uint8_t * codeLengths = dynamic ? lengths : fixedLengths;
+
+	putBits(final ? 1 : 0, 1);
+	putBits(dynamic ? 2 : 1, 2);
+	if (dynamic) {
+		uint16_t tokenCodes[19];
+		canonicalCodes(tokenLengths, 19, tokenCodes);
+
+		putBits(literalCount - 257, 5);
+		putBits(distanceCount - 1, 5);
+		putBits(tokenLengthCount - 4, 4);
+		for (int i = 0; i < tokenLengthCount; ++i) {
+			putBits(tokenLengths[LengthCodeOrder[i]], 3);
+		}
+		for (const Token & token : tokens) {
+			putHuffman(tokenCodes[token.symbol], tokenLengths[token.symbol]);
+			putBits(token.extra, token.extraBits);
+		}
+	}
+
+	uint16_t literalCodes[LiteralCodes];
+	uint16_t distanceCodes[DistanceCodes];
+	canonicalCodes(codeLengths, LiteralCodes, literalCodes);
+	canonicalCodes(codeLengths + LiteralCodes, DistanceCodes, distanceCodes);
+	const uint8_t * distanceLengths = codeLengths + LiteralCodes;
+
+	for (const Symbol & symbol : m_symbols) {
+		if (symbol.distance == 0) {
+			putHuffman(literalCodes[symbol.value], codeLengths[symbol.value]);
+		} else {
+			int length = lengthCode(symbol.value);
+			putHuffman(literalCodes[257 + length], codeLengths[257 + length]);
+			putBits(symbol.value - LengthBase[length], LengthExtra[length]);
+
+			int distance = distanceCode(symbol.distance);
+			putHuffman(distanceCodes[distance], distanceLengths[distance]);
+			putBits(symbol.distance - DistanceBase[distance], DistanceExtra[distance]);
+		}
+	}
+	putHuffman(literalCodes[EndOfBlock], codeLengths[EndOfBlock]);
+	m_symbols.clear();
+
+	if (m_pending.size() >= OutputChunk) {
+		flushOutput();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void DeflateStream::flushOutput()
+{
+	if (!m_pending.empty()) {
+		m_output(m_pending.data(), m_pending.size());
+		m_pending.clear();
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * A streaming zlib (RFC 1950/1951) compressor.
+ *
+ * Input is fed in with write() as it becomes available and compressed
+ * output is passed to the output function in pieces, so neither the whole
+ * input nor the whole output is ever held in memory: only the 32 KB window
+ * matches can refer back into, plus a little lookahead.
+ *
+ * Compression is greedy LZ77 over hash chains. Matches and literals are
+ * collected into blocks of a few tens of thousands, and each block is
+ * coded with Huffman tables built from its own statistics, or with the
+ * fixed tables where that comes out smaller.
+ */
+class DeflateStream {
+public:
+	typedef std::function<void(const unsigned char * data, size_t size)> Output;
+
+	enum class Framing {
+		// A complete zlib stream: header, deflate data, Adler-32.
+		Zlib,
+		// Bare deflate data, for one piece of a stream compressed in parts
+		// (see finish()). The caller writes the header and checksum.
+		Raw
+	};
+
+	explicit DeflateStream(const Output & output, Framing framing = Framing::Zlib);
+
+	void write(const unsigned char * data, size_t size);
+
+	// Compress everything written so far, end the stream and write the
+	// checksum. Nothing may be written afterwards.
+	//
+	// With Raw framing and last false, the data ends instead with an empty
+	// stored block on a byte boundary (a zlib "sync flush") and no final
+	// block, so that the output of another DeflateStream can follow it.
+	void finish(bool last = true);
+
+	// Adler-32 of everything written so far.
+	uint32_t adler32() const;
+
+	// Adler-32 of the concatenation of two pieces of data, from the
+	// checksums of each and the length of the second.
+	static uint32_t combineAdler32(uint32_t first, uint32_t second, uint64_t secondLength);
+
+private:
+	DeflateStream(const DeflateStream &) = delete;
+	DeflateStream & operator=(const DeflateStream &) = delete;
+
+	// Compress the buffered input, keeping enough back to find a full
+	// length match unless this is the end of the input.
+	void compress(bool final);
+
+	// A literal byte (distance 0) or a match of length bytes.
+	struct Symbol {
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	void insertHash(size_t position);
+	void putBits(uint32_t bits, int count);
+	void putHuffman(uint32_t code, int length);
+	// Code the symbols collected so far as one block.
+	void writeBlock(bool final);
+	void flushOutput();
+
+	Output m_output;
+	Framing m_framing;
+
+	// History window followed by input not compressed yet. m_buffer[0] is
+	// byte m_base of the stream.
+	std::vector<unsigned char> m_buffer;
+	uint64_t m_base;
+	size_t m_position;
+
+	// Most recent position of each 3 byte hash, and the previous position
+	// with the same hash for each position in the window (absolute + 1, so
+	// that 0 means none).
+	std::vector<uint64_t> m_head;
+	std::vector<uint64_t> m_previous;
+
+	std::vector<Symbol> m_symbols;
+
+	uint64_t m_bits;
+	int m_bitCount;
+	std::vector<unsigned char> m_pending;
+
+	uint32_t m_adlerA;
+	uint32_t m_adlerB;
+	bool m_finished;
+};
@@ -0,0 +1,593 @@
+#include "Distributed.hpp"
+
+#include <iostream>
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// A worker that has gone must not kill the coordinator with SIGPIPE. Linux
+// takes that per send(); macOS and the BSDs per socket, by SO_NOSIGPIPE.
+#ifdef MSG_NOSIGNAL
+static const int SendFlags = MSG_NOSIGNAL;
+#else
+static const int SendFlags = 0;
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// Tiles a worker is sent per thread ahead of those it has returned, so each
+// thread has the next one to start on while the coordinator reads the last.
+static const size_t JobsPerThread = 2;
+
+// Seconds a worker may take over a tile, or to reach a frame, before it is
+// dropped, and how often the coordinator looks.
+static const int WorkerTimeout = 60;
+static const int PollMilliseconds = 1000;
+
+enum class MessageType : uint32_t {
+	// Worker: reached frame, whose size is tile.x1 x tile.y1.
+	Ready,
+	// Coordinator: trace tile.
+	Job,
+	// Worker: tile's colours follow.
+	Pixels,
+	// Coordinator: there are no more tiles in this frame.
+	EndFrame,
+	// Worker: its TraceStats for the frame follow.
+	Stats
+};
+
+struct Message {
+	MessageType type;
+	uint32_t frame;
+	Tile tile;
+	// Ready: threads the worker traces on.
+	uint32_t threads;
+};
+
+//---------------------------------------------------------------------------------------
+static bool sendAll(int socket, const void * data, size_t size)
+{
+	const char * p = (const char *)data;
+	while (size > 0) {
+		ssize_t sent = send(socket, p, size, SendFlags);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		p += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+static bool receiveAll(int socket, void * data, size_t size)
+{
+	char * p = (char *)data;
+	while (size > 0) {
+		ssize_t received = recv(socket, p, size, 0);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		p += received;
+		size -= received;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+static bool sendMessage(int socket, MessageType type, uint32_t frame, const Tile & tile = Tile())
+{
+	Message message;
+	message.type = type;
+	message.frame = frame;
+	message.tile = tile;
+	message.threads = 0;
+	return sendAll(socket, &message, sizeof(message));
+}
+
+//---------------------------------------------------------------------------------------
+static bool readable(int socket)
+{
+	pollfd entry;
+	entry.fd = socket;
+	entry.events = POLLIN;
+	entry.revents = 0;
+	return poll(&entry, 1, 0) > 0;
+}
+
+//---------------------------------------------------------------------------------------
+static size_t pixelCount(const Tile & tile)
+{
+	return size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+}
+
+//---------------------------------------------------------------------------------------
+static bool sameTile(const Tile & a, const Tile & b)
+{
+	return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+//---------------------------------------------------------------------------------------
+static void noSigpipe(int socket)
+{
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+	(void)socket;
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+// Blocking calls on socket fail rather than wait on a hung worker for good.
+static void timeOut(int socket)
+{
+	timeval timeout;
+	timeout.tv_sec = WorkerTimeout;
+	timeout.tv_usec = 0;
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+//---------------------------------------------------------------------------------------
+// This program, for workers to run. Where the system cannot say, the
+// name it was started by, which execvp() looks up as the shell did.
+static std::string executablePath(const std::string & startedAs)
+{
+#if defined(__linux__)
+	(void)startedAs;
+	return "/proc/self/exe";
+#elif defined(__APPLE__)
+	char path[4096];
+	uint32_t size = sizeof(path);
+	if (_NSGetExecutablePath(path, &size) == 0) {
+		return path;
+	}
+	return startedAs;
+#else
+	return startedAs;
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+RenderCoordinator::RenderCoordinator(unsigned int workers, const std::vector<std::string> & args)
+	: m_frame(0)
+{
+	std::string program = executablePath(args.empty() ? std::string() : args[0]);
+
+	for (unsigned int i = 0; i < workers; ++i) {
+		// Close-on-exec, so that no worker inherits the others' sockets.
+		// Only this thread forks, so setting it after socketpair() is safe.
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+			std::perror("socketpair");
+			break;
+		}
+		fcntl(sockets[0], F_SETFD, FD_CLOEXEC);
+		fcntl(sockets[1], F_SETFD, FD_CLOEXEC);
+		noSigpipe(sockets[0]);
+		timeOut(sockets[0]);
+
+		// Everything the child needs is made before fork(), leaving it only
+		// calls that are safe in a copy of a threaded process.
+		std::vector<std::string> workerArgs = args;
+		workerArgs.push_back("--worker");
+		workerArgs.push_back(std::to_string(sockets[1]));
+		std::vector<char *> argv;
+		for (std::string & arg : workerArgs) {
+			argv.push_back(&arg[0]);
+		}
+		argv.push_back(nullptr);
+
+		// The child would otherwise write out our buffered output again.
+		std::fflush(nullptr);
+		pid_t pid = fork();
+		if (pid == 0) {
+			fcntl(sockets[1], F_SETFD, 0);
+			// Workers print what the coordinator already does; keep only
+			// their errors.
+			int null = open("/dev/null", O_WRONLY);
+			if (null >= 0) {
+				dup2(null, STDOUT_FILENO);
+			}
+			execvp(program.c_str(), argv.data());
+			_exit(127);
+		}
+
+		close(sockets[1]);
+		if (pid < 0) {
+			std::perror("fork");
+			close(sockets[0]);
+			break;
+		}
+
+		Worker worker;
+		worker.pid = pid;
+		worker.socket = sockets[0];
+		m_workers.push_back(worker);
+	}
+
+	std::cout << "Started " << m_workers.size() << " worker processes" << std::endl;
+}
+
+//---------------------------------------------------------------------------------------
+RenderCoordinator::~RenderCoordinator()
+{
+	for (const Worker & worker : m_workers) {
+		close(worker.socket);
+	}
+	for (const Worker & worker : m_workers) {
+		waitpid(worker.pid, nullptr, 0);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int RenderCoordinator::size() const
+{
+	return (unsigned int)m_workers.size();
+}
+
+//---------------------------------------------------------------------------------------
+void RenderCoordinator::drop(size_t worker)
+{
+	std::cerr << "Worker process " << m_workers[worker].pid
+		<< " failed, hung or is out of step; carrying on without it" << std::endl;
+	close(m_workers[worker].socket);
+	// SIGKILL, which reaches a worker even if it is stopped.
+	kill(m_workers[worker].pid, SIGKILL);
+	waitpid(m_workers[worker].pid, nullptr, 0);
+	m_workers.erase(m_workers.begin() + worker);
+}
+
+//---------------------------------------------------------------------------------------
+void RenderCoordinator::render(uint w, uint h, const std::vector<Tile> & tiles,
+	ThreadPool * pool, const TileScheduler::TileTask & renderHere, const TileSink & sink,
+	TraceStats & stats)
+{
+	++m_frame;
+
+	// Tiles a worker is dealt at once, by its thread count.
+	std::vector<size_t> capacity;
+	for (size_t i = m_workers.size(); i-- > 0;) {
+		Message ready;
+		if (!receiveAll(m_workers[i].socket, &ready, sizeof(ready))
+			|| ready.type != MessageType::Ready || ready.frame != m_frame
+			|| ready.tile.x1 != w || ready.tile.y1 != h || ready.threads == 0) {
+			drop(i);
+		} else {
+			capacity.insert(capacity.begin(), JobsPerThread * ready.threads);
+		}
+	}
+
+	// Indices into tiles: those neither sent nor taken here, and those each
+	// worker has been sent and not returned, which its threads return in
+	// any order. pending is shared with the threads rendering here.
+	std::mutex pendingMutex;
+	std::deque<size_t> pending;
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		pending.push_back(i);
+	}
+	std::vector<std::deque<size_t>> sent(m_workers.size());
+	std::vector<Clock::time_point> heard(m_workers.size());
+
+	auto nextHere = [&](size_t & index) {
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		if (pending.empty()) {
+			return false;
+		}
+		index = pending.back();
+		pending.pop_back();
+		return true;
+	};
+	auto workHere = [&](unsigned int worker) {
+		size_t index;
+		while (nextHere(index)) {
+			renderHere(worker, tiles[index]);
+		}
+	};
+	auto runHere = [&]() {
+		if (pool) {
+			pool->parallelFor(pool->size(), [&](unsigned int worker, size_t) {
+				workHere(worker);
+			});
+		} else {
+			workHere(0);
+		}
+	};
+
+	// Tiles here are taken from the back, the workers' from the front, so
+	// the two meet in the middle.
+	std::thread here;
+	if (!m_workers.empty()) {
+		here = std::thread(runHere);
+	}
+
+	auto dropWorker = [&](size_t worker) {
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			pending.insert(pending.begin(), sent[worker].begin(), sent[worker].end());
+		}
+		sent.erase(sent.begin() + worker);
+		heard.erase(heard.begin() + worker);
+		capacity.erase(capacity.begin() + worker);
+		drop(worker);
+	};
+
+	std::vector<glm::vec3> colours;
+	while (!m_workers.empty()) {
+		// Top every worker up, which also passes on a dropped one's tiles.
+		bool outstanding = false;
+		for (size_t i = m_workers.size(); i-- > 0;) {
+			while (sent[i].size() < capacity[i]) {
+				size_t index;
+				{
+					std::lock_guard<std::mutex> lock(pendingMutex);
+					if (pending.empty()) {
+						break;
+					}
+					index = pending.front();
+					pending.pop_front();
+				}
+				if (sent[i].empty()) {
+					heard[i] = Clock::now();
+				}
+				sent[i].push_back(index);
+				if (!sendMessage(m_workers[i].socket, MessageType::Job, m_frame, tiles[index])) {
+					dropWorker(i);
+					break;
+				}
+			}
+			outstanding = outstanding || (i < sent.size() && !sent[i].empty());
+		}
+		if (!outstanding) {
+			break;
+		}
+
+		std::vector<pollfd> polled;
+		for (const Worker & worker : m_workers) {
+			pollfd entry;
+			entry.fd = worker.socket;
+			entry.events = POLLIN;
+			entry.revents = 0;
+			polled.push_back(entry);
+		}
+		if (poll(polled.data(), polled.size(), PollMilliseconds) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::perror("poll");
+			while (!m_workers.empty()) {
+				dropWorker(m_workers.size() - 1);
+			}
+			break;
+		}
+
+		Clock::time_point now = Clock::now();
+		for (size_t i = polled.size(); i-- > 0;) {
+			if (polled[i].revents == 0) {
+				if (!sent[i].empty() && now - heard[i] > std::chrono::seconds(WorkerTimeout)) {
+					dropWorker(i);
+				}
+				continue;
+			}
+
+			Message message;
+			bool ok = receiveAll(m_workers[i].socket, &message, sizeof(message))
+				&& message.type == MessageType::Pixels && message.frame == m_frame;
+			auto job = sent[i].begin();
+			while (ok && job != sent[i].end() && !sameTile(message.tile, tiles[*job])) {
+				++job;
+			}
+			ok = ok && job != sent[i].end();
+			if (ok) {
+				colours.resize(pixelCount(message.tile));
+				ok = receiveAll(m_workers[i].socket, colours.data(),
+					colours.size() * sizeof(glm::vec3));
+			}
+			if (!ok) {
+				dropWorker(i);
+				continue;
+			}
+
+			sink(tiles[*job], colours);
+			sent[i].erase(job);
+			heard[i] = now;
+		}
+	}
+
+	// Anything a dropped worker left after the threads here ran out.
+	if (here.joinable()) {
+		here.join();
+	}
+	runHere();
+
+	for (size_t i = m_workers.size(); i-- > 0;) {
+		Message message;
+		TraceStats workerStats;
+		if (sendMessage(m_workers[i].socket, MessageType::EndFrame, m_frame)
+			&& receiveAll(m_workers[i].socket, &message, sizeof(message))
+			&& message.type == MessageType::Stats
+			&& receiveAll(m_workers[i].socket, &workerStats, sizeof(workerStats))) {
+			stats.merge(workerStats);
+		} else {
+			drop(i);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+CoordinatorConnection::CoordinatorConnection(int socket)
+	: m_socket(socket)
+	, m_frame(0)
+{
+	noSigpipe(m_socket);
+}
+
+//---------------------------------------------------------------------------------------
+CoordinatorConnection::~CoordinatorConnection()
+{
+	close(m_socket);
+}
+
+//---------------------------------------------------------------------------------------
+bool CoordinatorConnection::serve(uint w, uint h, ThreadPool * pool, const TileTracer & tracer)
+{
+	++m_frame;
+	Message ready;
+	ready.type = MessageType::Ready;
+	ready.frame = m_frame;
+	ready.tile = Tile{ 0, 0, w, h };
+	ready.threads = pool ? pool->size() : 1;
+	if (!sendAll(m_socket, &ready, sizeof(ready))) {
+		return false;
+	}
+
+	std::vector<Tile> batch;
+	std::mutex sendMutex;
+	bool sendFailed = false;
+	for (;;) {
+		// Wait for a job, then take every other one already sent, up to
+		// what the coordinator deals at once.
+		batch.clear();
+		do {
+			Message message;
+			if (!receiveAll(m_socket, &message, sizeof(message)) || message.frame != m_frame) {
+				return false;
+			}
+
+			// The coordinator ends the frame only once it has every tile.
+			if (message.type == MessageType::EndFrame) {
+				return batch.empty();
+			}
+
+			const Tile & tile = message.tile;
+			if (message.type != MessageType::Job
+				|| tile.x0 >= tile.x1 || tile.x1 > w || tile.y0 >= tile.y1 || tile.y1 > h) {
+				return false;
+			}
+			batch.push_back(tile);
+		} while (batch.size() < JobsPerThread * ready.threads && readable(m_socket));
+
+		// Each tile goes back as soon as it is done, so the coordinator can
+		// send another while the rest of the batch is traced.
+		auto traceJob = [&](unsigned int worker, size_t i) {
+			const Tile & tile = batch[i];
+			std::vector<glm::vec3> colours(pixelCount(tile), glm::vec3(0.0f));
+			tracer(worker, tile, colours);
+
+			std::lock_guard<std::mutex> lock(sendMutex);
+			sendFailed = sendFailed
+				|| !sendMessage(m_socket, MessageType::Pixels, m_frame, tile)
+				|| !sendAll(m_socket, colours.data(), colours.size() * sizeof(glm::vec3));
+		};
+		if (pool) {
+			pool->parallelFor(batch.size(), traceJob);
+		} else {
+			for (size_t i = 0; i < batch.size(); ++i) {
+				traceJob(0, i);
+			}
+		}
+		if (sendFailed) {
+			return false;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+bool CoordinatorConnection::sendStats(const TraceStats & stats)
+{
+	return sendMessage(m_socket, MessageType::Stats, m_frame)
+		&& sendAll(m_socket, &stats, sizeof(stats));
+}
+
+#else
+
+//---------------------------------------------------------------------------------------
+RenderCoordinator::RenderCoordinator(unsigned int, const std::vector<std::string> &)
+	: m_frame(0)
+{
+	std::cout << "Worker processes are not available on Windows; rendering here"
+		<< std::endl;
+}
+
+//---------------------------------------------------------------------------------------
+RenderCoordinator::~RenderCoordinator()
+{
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int RenderCoordinator::size() const
+{
+	return 0;
+}
+
+//---------------------------------------------------------------------------------------
+void RenderCoordinator::drop(size_t)
+{
+}
+
+//---------------------------------------------------------------------------------------
+void RenderCoordinator::render(uint, uint, const std::vector<Tile> & tiles, ThreadPool * pool,
+	const TileScheduler::TileTask & renderHere, const TileSink &, TraceStats &)
+{
+	if (pool) {
+		pool->parallelFor(tiles.size(), [&](unsigned int worker, size_t i) {
+			renderHere(worker, tiles[i]);
+		});
+	} else {
+		for (const Tile & tile : tiles) {
+			renderHere(0, tile);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+CoordinatorConnection::CoordinatorConnection(int socket)
+	: m_socket(socket)
+	, m_frame(0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+CoordinatorConnection::~CoordinatorConnection()
+{
+}
+
+//---------------------------------------------------------------------------------------
+bool CoordinatorConnection::serve(uint, uint, ThreadPool *, const TileTracer &)
+{
+	return false;
+}
+
+//---------------------------------------------------------------------------------------
+bool CoordinatorConnection::sendStats(const TraceStats &)
+{
+	return false;
+}
+
+#endif
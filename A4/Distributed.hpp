@@ -0,0 +1,101 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "RenderStats.hpp"
+#include "TileScheduler.hpp"
+
+/**
+ * Rendering across processes on one host.
+ *
+ * A coordinator starts copies of itself as workers, each connected to it
+ * by a Unix socket pair, and every worker runs the same script. Scripts
+ * are deterministic, so coordinator and workers reach the same renders in
+ * the same order with the same scene. For each frame the coordinator deals
+ * tiles out to the workers, a couple per worker thread so none waits on
+ * the socket, traces tiles itself meanwhile and assembles the pixels the
+ * workers send back. The workers never write an image.
+ *
+ * Every message is a Message, followed for pixels by the tile's colours
+ * and at the end of a frame by the worker's TraceStats, both as raw
+ * memory: the two ends are the same binary on the same machine. A worker
+ * that owes tiles or a frame and says nothing for a minute is taken to
+ * have hung.
+ *
+ * Only available on POSIX systems; on Windows no workers start and every
+ * frame is rendered by the coordinator.
+ */
+
+// Given each finished tile and its colours, a row at a time.
+typedef std::function<void(const Tile & tile, const std::vector<glm::vec3> & colours)>
+	TileSink;
+
+// Fills colours, already the tile's size, with the tile's pixels, on pool
+// thread worker.
+typedef std::function<void(unsigned int worker, const Tile & tile,
+	std::vector<glm::vec3> & colours)> TileTracer;
+
+class RenderCoordinator {
+public:
+	// Start workers copies of this program with command line args (the
+	// program first), to which --worker and the socket are added. Workers
+	// that cannot be started are left out.
+	RenderCoordinator(unsigned int workers, const std::vector<std::string> & args);
+
+	// Closes the sockets, which lets workers still waiting for a frame
+	// finish, and waits for them to exit.
+	~RenderCoordinator();
+
+	// Workers still connected.
+	unsigned int size() const;
+
+	// Render the tiles of the next w x h frame: the workers are dealt
+	// tiles, sink is called on this thread as each comes back, and the rest
+	// are rendered here by renderHere, on pool or, without one, on another
+	// thread as worker 0. Adds the workers' counts to stats once renderHere
+	// is done. A worker that fails, hangs or disagrees about the frame is
+	// dropped and its tiles dealt out again.
+	void render(uint w, uint h, const std::vector<Tile> & tiles, ThreadPool * pool,
+		const TileScheduler::TileTask & renderHere, const TileSink & sink, TraceStats & stats);
+
+private:
+	RenderCoordinator(const RenderCoordinator &) = delete;
+	RenderCoordinator & operator=(const RenderCoordinator &) = delete;
+
+	struct Worker {
+		int pid;
+		int socket;
+	};
+
+	void drop(size_t worker);
+
+	std::vector<Worker> m_workers;
+	uint32_t m_frame;
+};
+
+class CoordinatorConnection {
+public:
+	// Serve the coordinator on socket, as started by RenderCoordinator.
+	explicit CoordinatorConnection(int socket);
+	~CoordinatorConnection();
+
+	// Take part in the next w x h frame: trace the tiles the coordinator
+	// asks for with tracer, as many at once as pool has threads, until it
+	// ends the frame. Returns false if the coordinator has gone or is on
+	// another frame.
+	bool serve(uint w, uint h, ThreadPool * pool, const TileTracer & tracer);
+
+	// Send the coordinator the frame's counts, after serve().
+	bool sendStats(const TraceStats & stats);
+
+private:
+	CoordinatorConnection(const CoordinatorConnection &) = delete;
+	CoordinatorConnection & operator=(const CoordinatorConnection &) = delete;
+
+	int m_socket;
+	uint32_t m_frame;
+};
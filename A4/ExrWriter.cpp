@@ -0,0 +1,229 @@
+#include "ExrWriter.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "Deflate.hpp"
+#include "Half.hpp"
+
+// Header values from the OpenEXR file layout.
+static const uint32_t Magic = 20000630;
+static const uint32_t Version = 2;
+static const int PixelTypeHalf = 1;
+static const int PixelTypeFloat = 2;
+static const unsigned char ZipCompression = 3;
+static const unsigned char IncreasingY = 0;
+static const uint LinesPerChunk = 16;
+
+namespace {
+
+// Little endian output into a byte buffer.
+class ByteWriter {
+public:
+	explicit ByteWriter(std::vector<unsigned char> & bytes) : m_bytes(bytes) {}
+
+	void u8(unsigned char v) { m_bytes.push_back(v); }
+	void i32(int32_t v) { u32(uint32_t(v)); }
+	void u32(uint32_t v) {
+		for (int i = 0; i < 4; ++i) {
+			m_bytes.push_back((unsigned char)(v >> (8 * i)));
+		}
+	}
+	void u64(uint64_t v) {
+		for (int i = 0; i < 8; ++i) {
+			m_bytes.push_back((unsigned char)(v >> (8 * i)));
+		}
+	}
+	void f32(float v) {
+		uint32_t bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		u32(bits);
+	}
+	void str(const char * s) {
+		m_bytes.insert(m_bytes.end(), s, s + std::strlen(s) + 1);
+	}
+
+	// An attribute: name, type, size and then the value, which the caller
+	// writes next and which must be size bytes long.
+	void attribute(const char * name, const char * type, int32_t size) {
+		str(name);
+		str(type);
+		i32(size);
+	}
+
+private:
+	std::vector<unsigned char> & m_bytes;
+};
+
+} // namespace
+
+//---------------------------------------------------------------------------------------
+static void writeHeader(std::vector<unsigned char> & bytes, uint width, uint height,
+	int pixelType)
+{
+	ByteWriter out(bytes);
+	out.u32(Magic);
+	out.u32(Version);
+
+	// Channels must be in alphabetical order: B, G, R. Each is its name,
+	// pixel type, pLinear and three reserved bytes, x and y sampling.
+	const char * channels[] = { "B", "G", "R" };
+	out.attribute("channels", "chlist", 3 * (2 + 16) + 1);
+	for (const char * name : channels) {
+		out.str(name);
+		out.i32(pixelType);
+		out.u32(0);
+		out.i32(1);
+		out.i32(1);
+	}
+	out.u8(0);
+
+	out.attribute("compression", "compression", 1);
+	out.u8(ZipCompression);
+
+	const char * windows[] = { "dataWindow", "displayWindow" };
+	for (const char * name : windows) {
+		out.attribute(name, "box2i", 16);
+		out.i32(0);
+		out.i32(0);
+		out.i32(int32_t(width) - 1);
+		out.i32(int32_t(height) - 1);
+	}
+
+	out.attribute("lineOrder", "lineOrder", 1);
+	out.u8(IncreasingY);
+
+	out.attribute("pixelAspectRatio", "float", 4);
+	out.f32(1.0f);
+
+	out.attribute("screenWindowCenter", "v2f", 8);
+	out.f32(0.0f);
+	out.f32(0.0f);
+
+	out.attribute("screenWindowWidth", "float", 4);
+	out.f32(1.0f);
+
+	out.u8(0);
+}
+
+//---------------------------------------------------------------------------------------
+// Split bytes into the even and odd ones, then store each as the difference
+// from the one before, as OpenEXR does before zlib: floats of neighbouring
+// pixels then share long runs of similar bytes.
+static void predict(const std::vector<unsigned char> & raw, std::vector<unsigned char> & out)
+{
+	size_t size = raw.size();
+	out.resize(size);
+	unsigned char * even = out.data();
+	unsigned char * odd = out.data() + (size + 1) / 2;
+	for (size_t i = 0; i < size; ++i) {
+		if (i & 1) {
+			*odd++ = raw[i];
+		} else {
+			*even++ = raw[i];
+		}
+	}
+
+	unsigned char previous = size ? out[0] : 0;
+	for (size_t i = 1; i < size; ++i) {
+		unsigned char current = out[i];
+		out[i] = (unsigned char)(int(current) - int(previous) + 128);
+		previous = current;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+bool writeExr(const Image & image, const std::string & filename)
+{
+	uint width = image.width();
+	uint height = image.height();
+	bool half = image.format() == Image::Format::Half;
+	size_t valueSize = half ? 2 : 4;
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	std::vector<unsigned char> header;
+	writeHeader(header, width, height, half ? PixelTypeHalf : PixelTypeFloat);
+
+	// The offset table comes before the chunks but depends on their
+	// compressed sizes, so leave room for it and fill it in at the end.
+	uint chunks = (height + LinesPerChunk - 1) / LinesPerChunk;
+	std::vector<uint64_t> offsets(chunks);
+	file.write((const char *)header.data(), header.size());
+	std::vector<unsigned char> table(8 * size_t(chunks), 0);
+	file.write((const char *)table.data(), table.size());
+	uint64_t position = header.size() + table.size();
+
+	std::vector<float> row(3 * width);
+	std::vector<unsigned char> raw;
+	std::vector<unsigned char> predicted;
+	std::vector<unsigned char> compressed;
+	std::vector<unsigned char> chunk;
+
+	for (uint c = 0; c < chunks; ++c) {
+		uint y0 = c * LinesPerChunk;
+		uint lines = std::min(LinesPerChunk, height - y0);
+
+		// Each scanline holds all of B, then all of G, then all of R.
+		raw.resize(size_t(lines) * 3 * width * valueSize);
+		unsigned char * out = raw.data();
+		for (uint y = y0; y < y0 + lines; ++y) {
+			image.readRow(y, row.data());
+			for (int channel = 2; channel >= 0; --channel) {
+				for (uint x = 0; x < width; ++x) {
+					float value = row[3 * x + channel];
+					if (half) {
+						uint16_t bits = floatToHalf(value);
+						*out++ = (unsigned char)bits;
+						*out++ = (unsigned char)(bits >> 8);
+					} else {
+						uint32_t bits;
+						std::memcpy(&bits, &value, sizeof(bits));
+						for (int i = 0; i < 4; ++i) {
+							*out++ = (unsigned char)(bits >> (8 * i));
+						}
+					}
+				}
+			}
+		}
+
+		predict(raw, predicted);
+		compressed.clear();
+		DeflateStream deflate([&compressed](const unsigned char * data, size_t size) {
+			compressed.insert(compressed.end(), data, data + size);
+		});
+		deflate.write(predicted.data(), predicted.size());
+		deflate.finish();
+
+		// Readers take a chunk no smaller than the raw data to be uncompressed.
+		const std::vector<unsigned char> & data =
+			compressed.size() < raw.size() ? compressed : raw;
+
+		chunk.clear();
+		ByteWriter chunkOut(chunk);
+		chunkOut.i32(int32_t(y0));
+		chunkOut.i32(int32_t(data.size()));
+		file.write((const char *)chunk.data(), chunk.size());
+		file.write((const char *)data.data(), data.size());
+
+		offsets[c] = position;
+		position += chunk.size() + data.size();
+	}
+
+	table.clear();
+	ByteWriter tableOut(table);
+	for (uint64_t offset : offsets) {
+		tableOut.u64(offset);
+	}
+	file.seekp(header.size());
+	file.write((const char *)table.data(), table.size());
+
+	file.close();
+	return !file.fail();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "Image.hpp"
+
+// Write image as a single part, scanline OpenEXR file with R, G and B
+// channels. Float images are written as 32-bit float and Half images as
+// half, so nothing is lost either way. Scanlines are compressed 16 at a
+// time as in ZIP_COMPRESSION, and stored as they are where that does not
+// make them smaller. Rows are read straight from the image one at a time.
+bool writeExr(const Image & image, const std::string & filename);
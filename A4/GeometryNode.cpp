@@ -5,23 +5,25 @@ GeometryNode::GeometryNode(
 	const std::string & name, Primitive *prim, Material *mat )
 	: SceneNode( name )
 	, m_material( mat )
-	, m_primitive( prim )
+	// Aliasing an empty shared_ptr: no ownership and no control block.
+	, m_primitive( std::shared_ptr<Primitive>(), prim )
 {
 	m_nodeType = NodeType::GeometryNode;
 }
 
-void GeometryNode::setMaterial( Material *mat )
+//---------------------------------------------------------------------------------------
+GeometryNode::GeometryNode(
+	const std::string & name, std::shared_ptr<Primitive> prim, Material *mat )
+	: SceneNode( name )
+	, m_material( mat )
+	, m_primitive( std::move( prim ) )
 {
-	// Obviously, there's a potential memory leak here.  A good solution
-	// would be to use some kind of reference counting, as in the 
-	// C++ shared_ptr.  But I'm going to punt on that problem here.
-	// Why?  Two reasons:
-	// (a) In practice we expect the scene to be constructed exactly
-	//     once.  There's no reason to believe that materials will be
-	//     repeatedly overwritten in a GeometryNode.
-	// (b) A ray tracer is a program in which you compute once, and 
-	//     throw away all your data.  A memory leak won't build up and
-	//     crash the program.
+	m_nodeType = NodeType::GeometryNode;
+}
 
+void GeometryNode::setMaterial( Material *mat )
+{
+	// Materials belong to the Arena the scene was made in, not to the
+	// nodes using them, so the old one needs no freeing.
 	m_material = mat;
 }
@@ -1,16 +1,25 @@
 #pragma once
 
+#include <memory>
+
 #include "SceneNode.hpp"
 #include "Primitive.hpp"
 #include "Material.hpp"
 
 class GeometryNode : public SceneNode {
 public:
+	// Does not take ownership of prim, which must outlive the node, e.g. by
+	// being made in the same Arena.
 	GeometryNode( const std::string & name, Primitive *prim, 
 		Material *mat = nullptr );
 
+	// Shares prim with any other nodes holding it, so that e.g. one Mesh
+	// and its BVH can be placed under several transforms.
+	GeometryNode( const std::string & name, std::shared_ptr<Primitive> prim,
+		Material *mat = nullptr );
+
 	void setMaterial( Material *material );
 
 	Material *m_material;
-	Primitive *m_primitive;
+	std::shared_ptr<Primitive> m_primitive;
 };
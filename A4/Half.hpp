@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Conversions between float and IEEE 754 half precision (binary16), for
+// storing colours in two bytes per channel. Rounds to nearest even;
+// values too large for a half become infinity.
+
+//---------------------------------------------------------------------------------------
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t f;
+	std::memcpy(&f, &value, sizeof(f));
+
+	uint32_t sign = (f >> 16) & 0x8000;
+	uint32_t exponent = (f >> 23) & 0xff;
+	uint32_t mantissa = f & 0x7fffff;
+
+	// NaN stays NaN, infinity stays infinity.
+	if (exponent == 0xff) {
+		return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+
+	int halfExponent = int(exponent) - 127 + 15;
+	if (halfExponent >= 0x1f) {
+		return uint16_t(sign | 0x7c00);
+	}
+
+	if (halfExponent <= 0) {
+		// Subnormal half, or zero.
+		if (halfExponent < -10) {
+			return uint16_t(sign);
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t(14 - halfExponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			++half;
+		}
+		return uint16_t(sign | half);
+	}
+
+	uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	// A carry out of the mantissa correctly bumps the exponent, up to infinity.
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		++half;
+	}
+	return uint16_t(sign | half);
+}
+
+//---------------------------------------------------------------------------------------
+inline float halfToFloat(uint16_t half)
+{
+	uint32_t sign = uint32_t(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	uint32_t f;
+	if (exponent == 0x1f) {
+		f = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		f = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	} else if (mantissa == 0) {
+		f = sign;
+	} else {
+		// Subnormal half: normalise it.
+		exponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--exponent;
+		}
+		f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+
+	float value;
+	std::memcpy(&value, &f, sizeof(value));
+	return value;
+}
@@ -1,15 +1,46 @@
 #include "Image.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <iostream>
 #include <cstring>
-#include <lodepng/lodepng.h>
+#include <vector>
+
+#include "ExrWriter.hpp"
+#include "Half.hpp"
+#include "PngWriter.hpp"
 
 const uint Image::m_colorComponents = 3; // Red, blue, green
+const uint Image::TileSize;
+
+//---------------------------------------------------------------------------------------
+Image::Component::Component(Image & image, size_t index)
+  : m_image(image),
+    m_index(index)
+{
+}
+
+//---------------------------------------------------------------------------------------
+Image::Component & Image::Component::operator=(double value)
+{
+  m_image.set(m_index, float(value));
+  return *this;
+}
+
+//---------------------------------------------------------------------------------------
+Image::Component::operator double() const
+{
+  return m_image.get(m_index);
+}
 
 //---------------------------------------------------------------------------------------
 Image::Image()
   : m_width(0),
     m_height(0),
+    m_tilesAcross(0),
+    m_format(Format::Float),
+    m_size(0),
     m_data(0)
 {
 }
@@ -17,25 +48,33 @@ Image::Image()
 //---------------------------------------------------------------------------------------
 Image::Image(
 		uint width,
-		uint height
+		uint height,
+		Format format
 )
   : m_width(width),
-    m_height(height)
+    m_height(height),
+    m_tilesAcross((width + TileSize - 1) / TileSize),
+    m_format(format)
 {
-	size_t numElements = m_width * m_height * m_colorComponents;
-	m_data = new double[numElements];
-	memset(m_data, 0, numElements*sizeof(double));
+	size_t tilesDown = (height + TileSize - 1) / TileSize;
+	size_t numElements = m_tilesAcross * tilesDown * TileSize * TileSize * m_colorComponents;
+	m_size = numElements * (format == Format::Half ? sizeof(uint16_t) : sizeof(float));
+	m_data = new unsigned char[m_size];
+	// All bits zero is 0.0 as both a float and a half.
+	memset(m_data, 0, m_size);
 }
 
 //---------------------------------------------------------------------------------------
 Image::Image(const Image & other)
   : m_width(other.m_width),
     m_height(other.m_height),
-    m_data(other.m_data ? new double[m_width * m_height * m_colorComponents] : 0)
+    m_tilesAcross(other.m_tilesAcross),
+    m_format(other.m_format),
+    m_size(other.m_size),
+    m_data(other.m_data ? new unsigned char[other.m_size] : 0)
 {
   if (m_data) {
-    std::memcpy(m_data, other.m_data,
-                m_width * m_height * m_colorComponents * sizeof(double));
+    std::memcpy(m_data, other.m_data, m_size);
   }
 }
 
@@ -48,17 +87,21 @@ Image::~Image()
 //---------------------------------------------------------------------------------------
 Image & Image::operator=(const Image& other)
 {
+  if (this == &other) {
+    return *this;
+  }
+
   delete [] m_data;
   
   m_width = other.m_width;
   m_height = other.m_height;
-  m_data = (other.m_data ? new double[m_width * m_height * m_colorComponents] : 0);
+  m_tilesAcross = other.m_tilesAcross;
+  m_format = other.m_format;
+  m_size = other.m_size;
+  m_data = (other.m_data ? new unsigned char[m_size] : 0);
 
   if (m_data) {
-    std::memcpy(m_data,
-                other.m_data,
-                m_width * m_height * m_colorComponents * sizeof(double)
-    );
+    std::memcpy(m_data, other.m_data, m_size);
   }
   
   return *this;
@@ -76,16 +119,118 @@ uint Image::height() const
   return m_height;
 }
 
+//---------------------------------------------------------------------------------------
+Image::Format Image::format() const
+{
+  return m_format;
+}
+
+//---------------------------------------------------------------------------------------
+size_t Image::index(uint x, uint y, uint i) const
+{
+  size_t tile = size_t(y / TileSize) * m_tilesAcross + x / TileSize;
+  size_t pixel = (y % TileSize) * TileSize + x % TileSize;
+  return (tile * TileSize * TileSize + pixel) * m_colorComponents + i;
+}
+
+//---------------------------------------------------------------------------------------
+float Image::get(size_t index) const
+{
+  if (m_format == Format::Half) {
+    return halfToFloat(reinterpret_cast<const uint16_t *>(m_data)[index]);
+  }
+  return reinterpret_cast<const float *>(m_data)[index];
+}
+
+//---------------------------------------------------------------------------------------
+void Image::set(size_t index, float value)
+{
+  if (m_format == Format::Half) {
+    reinterpret_cast<uint16_t *>(m_data)[index] = floatToHalf(value);
+  } else {
+    reinterpret_cast<float *>(m_data)[index] = value;
+  }
+}
+
 //---------------------------------------------------------------------------------------
 double Image::operator()(uint x, uint y, uint i) const
 {
-  return m_data[m_colorComponents * (m_width * y + x) + i];
+  return get(index(x, y, i));
+}
+
+//---------------------------------------------------------------------------------------
+Image::Component Image::operator()(uint x, uint y, uint i)
+{
+  return Component(*this, index(x, y, i));
 }
 
 //---------------------------------------------------------------------------------------
-double & Image::operator()(uint x, uint y, uint i)
+void Image::setPixels(uint x0, uint y0, uint width, uint height, const float * rgb)
 {
-  return m_data[m_colorComponents * (m_width * y + x) + i];
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			// Consecutive pixels within a tile row are contiguous.
+			size_t base = index(x0 + x, y0 + y, 0);
+			const float * pixel = rgb + m_colorComponents * (y * width + x);
+			for (uint i = 0; i < m_colorComponents; ++i) {
+				set(base + i, pixel[i]);
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void Image::readRow(uint y, float * rgb) const
+{
+	for (uint x = 0; x < m_width; x += TileSize) {
+		// One tile's worth of the row is contiguous.
+		size_t base = index(x, y, 0);
+		uint count = m_colorComponents * std::min(TileSize, m_width - x);
+		float * out = rgb + m_colorComponents * x;
+		if (m_format == Format::Half) {
+			const uint16_t * in = reinterpret_cast<const uint16_t *>(m_data) + base;
+			for (uint i = 0; i < count; ++i) {
+				out[i] = halfToFloat(in[i]);
+			}
+		} else {
+			std::memcpy(out, reinterpret_cast<const float *>(m_data) + base, count * sizeof(float));
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+Image::FileType Image::fileType(const std::string & filename)
+{
+	size_t dot = filename.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+		[](unsigned char c) { return (char)std::tolower(c); });
+
+	if (extension == "pfm") {
+		return FileType::Pfm;
+	} else if (extension == "exr") {
+		return FileType::Exr;
+	}
+	return FileType::Png;
+}
+
+//---------------------------------------------------------------------------------------
+bool Image::save(const std::string & filename) const
+{
+	return save(filename, fileType(filename));
+}
+
+//---------------------------------------------------------------------------------------
+bool Image::save(const std::string & filename, FileType type) const
+{
+	switch (type) {
+		case FileType::Pfm:
+			return savePfm(filename);
+		case FileType::Exr:
+			return saveExr(filename);
+		default:
+			return savePng(filename);
+	}
 }
 
 //---------------------------------------------------------------------------------------
@@ -97,40 +242,82 @@ static double clamp(double x, double a, double b)
 //---------------------------------------------------------------------------------------
 bool Image::savePng(const std::string & filename) const
 {
-	std::vector<unsigned char> image;
+	// Rows are converted as the encoder's threads ask for them.
+	bool ok = writePngParallel(filename, m_width, m_height,
+		[this](uint y, unsigned char * rgb) {
+			std::vector<float> row(m_colorComponents * m_width);
+			readRow(y, row.data());
+			for (size_t i = 0; i < row.size(); ++i) {
+				double color = clamp(row[i], 0.0, 1.0);
+				rgb[i] = (unsigned char)(255 * color);
+			}
+		});
+
+	if (!ok) {
+		std::cerr << "Could not write " << filename << std::endl;
+	}
+	return ok;
+}
+
+//---------------------------------------------------------------------------------------
+bool Image::savePfm(const std::string & filename) const
+{
+	FILE * file = std::fopen(filename.c_str(), "wb");
+	if (!file) {
+		std::cerr << "Could not create " << filename << std::endl;
+		return false;
+	}
 
-	image.resize(m_width * m_height * m_colorComponents);
+	// A negative scale means little endian floats. Rows go bottom to top.
+	std::fprintf(file, "PF\n%u %u\n-1.0\n", m_width, m_height);
 
-	double color;
-	for (uint y(0); y < m_height; y++) {
-		for (uint x(0); x < m_width; x++) {
-			for (uint i(0); i < m_colorComponents; ++i) {
-				color = m_data[m_colorComponents * (m_width * y + x) + i];
-				color = clamp(color, 0.0, 1.0);
-				image[m_colorComponents * (m_width * y + x) + i] = (unsigned char)(255 * color);
+	const uint16_t probe = 1;
+	bool littleEndian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+
+	std::vector<float> row(m_colorComponents * m_width);
+	for (uint y = m_height; y-- > 0; ) {
+		readRow(y, row.data());
+		if (!littleEndian) {
+			for (float & value : row) {
+				unsigned char * bytes = reinterpret_cast<unsigned char *>(&value);
+				std::reverse(bytes, bytes + sizeof(float));
 			}
 		}
+		std::fwrite(row.data(), sizeof(float), row.size(), file);
 	}
 
-	// Encode the image
-	unsigned error = lodepng::encode(filename, image, m_width, m_height, LCT_RGB);
-
-	if(error) {
-		std::cerr << "encoder error " << error << ": " << lodepng_error_text(error)
-				<< std::endl;
+	bool ok = !std::ferror(file);
+	ok = std::fclose(file) == 0 && ok;
+	if (!ok) {
+		std::cerr << "Could not write " << filename << std::endl;
 	}
+	return ok;
+}
 
-	return true;
+//---------------------------------------------------------------------------------------
+bool Image::saveExr(const std::string & filename) const
+{
+	bool ok = writeExr(*this, filename);
+	if (!ok) {
+		std::cerr << "Could not write " << filename << std::endl;
+	}
+	return ok;
 }
 
 //---------------------------------------------------------------------------------------
-const double * Image::data() const
+const void * Image::rawData() const
 {
   return m_data;
 }
 
 //---------------------------------------------------------------------------------------
-double * Image::data()
+void * Image::rawData()
 {
   return m_data;
 }
+
+//---------------------------------------------------------------------------------------
+size_t Image::rawSize() const
+{
+  return m_size;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 typedef unsigned int uint;
@@ -8,17 +10,55 @@ typedef unsigned int uint;
  * An image, consisting of a rectangle of floating-point elements.
  * Each pixel element consists of 3 components: Red, Blue, and Green.
  *
+ * Components are stored as floats, or as halves to save memory, in
+ * TileSize x TileSize tiles so that a renderer working a tile at a time
+ * touches one contiguous block. Edge tiles are padded to full size.
+ *
  * This class makes it easy to save the image as a PNG file.
  * Note that colours in the range [0.0, 1.0] are mapped to the integer
- * range [0, 255] when writing PNG files.
+ * range [0, 255] when writing PNG files. PFM and OpenEXR files keep the
+ * stored values as they are.
  */
 class Image {
 public:
+	enum class Format {
+		// 4 bytes per component.
+		Float,
+		// 2 bytes per component, about 3 significant digits.
+		Half
+	};
+
+	enum class FileType {
+		Png,
+		// Portable float map: uncompressed 32-bit float RGB.
+		Pfm,
+		// OpenEXR scanline image, float or half to match the storage,
+		// zlib compressed in blocks of 16 scanlines.
+		Exr
+	};
+
+	// Side of the square tiles pixels are stored in.
+	static const uint TileSize = 16;
+
+	// A writable reference to one component of one pixel.
+	class Component {
+	public:
+		Component & operator=(double value);
+		operator double() const;
+
+	private:
+		friend class Image;
+		Component(Image & image, size_t index);
+
+		Image & m_image;
+		size_t m_index;
+	};
+
 	// Construct an empty image.
 	Image();
 
 	// Construct a black image at the given width/height.
-	Image(uint width, uint height);
+	Image(uint width, uint height, Format format = Format::Float);
 
 	// Copy an image.
 	Image(const Image & other);
@@ -34,23 +74,52 @@ public:
 	// Returns the height of the image.
 	uint height() const;
 
+	Format format() const;
+
     // Retrieve a particular component from the image.
 	double operator()(uint x, uint y, uint i) const;
 
 	// Retrieve a particular component from the image.
-	double & operator()(uint x, uint y, uint i);
+	Component operator()(uint x, uint y, uint i);
+
+	// Copy a block of pixels in, given as rows of RGB triples.
+	void setPixels(uint x0, uint y0, uint width, uint height, const float * rgb);
+
+	// Copy row y out as width() RGB triples.
+	void readRow(uint y, float * rgb) const;
+
+	// The type to save filename as, from its extension (in any case):
+	// .pfm or .exr, and PNG for anything else.
+	static FileType fileType(const std::string & filename);
+
+	// Save in the format given by the extension of filename, or in type.
+	bool save(const std::string & filename) const;
+	bool save(const std::string & filename, FileType type) const;
 
 	// Save this image into the PNG file with name 'filename'.
 	// Warning: If 'filename' already exists, it will be overwritten.
 	bool savePng(const std::string & filename) const;
 
-	const double * data() const;
-	double * data();
+	bool savePfm(const std::string & filename) const;
+	bool saveExr(const std::string & filename) const;
+
+	// The stored components, in tile order, for saving and restoring the
+	// image exactly.
+	const void * rawData() const;
+	void * rawData();
+	size_t rawSize() const;
 
 private:
+	size_t index(uint x, uint y, uint i) const;
+	float get(size_t index) const;
+	void set(size_t index, float value);
+
 	uint m_width;
 	uint m_height;
-	double * m_data;
+	uint m_tilesAcross;
+	Format m_format;
+	size_t m_size;
+	unsigned char * m_data;
 
 	static const uint m_colorComponents;
 };
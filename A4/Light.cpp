@@ -1,18 +1,71 @@
+#include <cmath>
 #include <iostream>
 
 #include <glm/ext.hpp>
 
 #include "Light.hpp"
 
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
 Light::Light()
   : colour(0.0, 0.0, 0.0),
-    position(0.0, 0.0, 0.0)
+    position(0.0, 0.0, 0.0),
+    shape(LightShape::Point),
+    u(0.0f),
+    v(0.0f),
+    radius(0.0),
+    samples(16),
+    adaptive(true)
 {
   falloff[0] = 1.0;
   falloff[1] = 0.0;
   falloff[2] = 0.0;
 }
 
+glm::vec3 Light::samplePoint(float s, float t, const glm::vec3& from) const
+{
+  switch (shape) {
+    case LightShape::Rectangle:
+      return position + (s - 0.5f) * u + (t - 0.5f) * v;
+
+    case LightShape::Sphere: {
+      glm::vec3 axis = from - position;
+      float distance = glm::length(axis);
+      if (distance <= radius) {
+        return position;
+      }
+      axis /= distance;
+
+      // Shirley and Chiu's concentric map from the square to the disk,
+      // which keeps strata of the square compact on the disk.
+      float a = 2.0f * s - 1.0f;
+      float b = 2.0f * t - 1.0f;
+      float r, phi;
+      if (a == 0.0f && b == 0.0f) {
+        r = 0.0f;
+        phi = 0.0f;
+      } else if (std::abs(a) > std::abs(b)) {
+        r = a;
+        phi = float(M_PI / 4.0) * (b / a);
+      } else {
+        r = b;
+        phi = float(M_PI / 2.0) - float(M_PI / 4.0) * (a / b);
+      }
+
+      glm::vec3 e1 = glm::normalize(glm::cross(axis,
+        std::abs(axis.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+      glm::vec3 e2 = glm::cross(axis, e1);
+      r *= float(radius);
+      return position + r * (std::cos(phi) * e1 + std::sin(phi) * e2);
+    }
+
+    default:
+      return position;
+  }
+}
+
 std::ostream& operator<<(std::ostream& out, const Light& l)
 {
   out << "L[" << glm::to_string(l.colour) 
@@ -21,6 +74,14 @@ std::ostream& operator<<(std::ostream& out, const Light& l)
     if (i > 0) out << ", ";
     out << l.falloff[i];
   }
+  if (l.shape == LightShape::Rectangle) {
+    out << ", rectangle " << glm::to_string(l.u) << " x " << glm::to_string(l.v);
+  } else if (l.shape == LightShape::Sphere) {
+    out << ", sphere radius " << l.radius;
+  }
+  if (l.shape != LightShape::Point) {
+    out << ", " << l.samples << (l.adaptive ? " adaptive" : "") << " samples";
+  }
   out << "]";
   return out;
 }
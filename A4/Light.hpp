@@ -1,16 +1,46 @@
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 
 #include <glm/glm.hpp>
 
-// Represents a simple point light.
+enum class LightShape : uint8_t {
+  Point,
+  // A parallelogram centred on position with edges u and v.
+  Rectangle,
+  // A sphere of the given radius around position.
+  Sphere
+};
+
+// A point light, or an area light casting soft shadows. An area light is
+// sampled at points spread over it, the shading from each weighted
+// equally, so its colour is its total as for a point light.
 struct Light {
   Light();
-  
+
+  // The point on the light at (s, t) in the unit square, as seen from
+  // the point from. A sphere is sampled across the disk it shows there.
+  glm::vec3 samplePoint(float s, float t, const glm::vec3& from) const;
+
   glm::vec3 colour;
   glm::vec3 position;
   double falloff[3];
+
+  LightShape shape;
+  glm::vec3 u;
+  glm::vec3 v;
+  double radius;
+
+  // Area lights only. Each shading point takes samples samples, rounded
+  // down to a square grid of strata with one jittered sample in each.
+  // With adaptive set, shadow rays to the light's corners come first, and
+  // the samples only need shadow rays of their own if the corners
+  // disagree about whether the light is seen, i.e. in the penumbra. That
+  // misses the shadows of occluders small enough to hide only the middle
+  // of the light; turn it off for scenes that have them.
+  unsigned int samples;
+  bool adaptive;
 };
 
 std::ostream& operator<<(std::ostream& out, const Light& l);
@@ -1,11 +1,66 @@
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
 #include "scene_lua.hpp"
+#include "A4.hpp"
 
 int main(int argc, char** argv)
 {
   std::string filename = "Assets/simple.lua";
-  if (argc >= 2) {
-    filename = argv[1];
+  RenderSettings settings;
+  unsigned int workers = 0;
+
+  // Worker processes run with the same options, except for those only the
+  // coordinator acts on.
+  std::vector<std::string> workerArgs = { argv[0] };
+
+  for (int i = 1; i < argc; ++i) {
+    int option = i;
+    if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      settings.threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--packets") == 0) {
+      settings.packetTracing = true;
+    } else if (std::strcmp(argv[i], "--progressive") == 0 && i + 1 < argc) {
+      settings.checkpointInterval = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--half") == 0) {
+      settings.imageFormat = Image::Format::Half;
+    } else if (std::strcmp(argv[i], "--stream") == 0) {
+      settings.streamingOutput = true;
+    } else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      std::sscanf(argv[++i], "%ux%u", &settings.width, &settings.height);
+    } else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+      A4_SetStatsFile(argv[++i]);
+      continue;
+    } else if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      workers = std::atoi(argv[++i]);
+      continue;
+    } else if (std::strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+      A4_ServeCoordinator(std::atoi(argv[++i]));
+      continue;
+    } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+      settings.samplesPerPixel = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--aa") == 0 && i + 1 < argc) {
+      settings.supersamplingDepth = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--aa-threshold") == 0 && i + 1 < argc) {
+      settings.supersamplingThreshold = (float)std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+      settings.maxDepth = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--ray-budget") == 0 && i + 1 < argc) {
+      settings.rayBudget = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--indexed-meshes") == 0) {
+      settings.meshLayout = TriangleLayout::Indexed;
+    } else {
+      filename = argv[i];
+    }
+    workerArgs.insert(workerArgs.end(), argv + option, argv + i + 1);
+  }
+
+  A4_SetDefaultSettings(settings);
+  if (workers > 0) {
+    A4_SetWorkerProcesses(workers, workerArgs);
   }
 
   if (!run_lua(filename)) {
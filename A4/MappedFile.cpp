@@ -0,0 +1,141 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+//---------------------------------------------------------------------------------------
+MappedFile::MappedFile()
+	: m_data(nullptr),
+	  m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE),
+	  m_mapping(nullptr)
+#endif
+{
+}
+
+//---------------------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+//---------------------------------------------------------------------------------------
+const char * MappedFile::data() const
+{
+	return m_data;
+}
+
+//---------------------------------------------------------------------------------------
+size_t MappedFile::size() const
+{
+	return m_size;
+}
+
+#ifdef _WIN32
+
+//---------------------------------------------------------------------------------------
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+
+	m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size)) {
+		close();
+		return false;
+	}
+	if (size.QuadPart == 0) {
+		return true;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping) {
+		close();
+		return false;
+	}
+
+	m_data = (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data) {
+		close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void MappedFile::close()
+{
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_file);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+//---------------------------------------------------------------------------------------
+bool MappedFile::open(const std::string & filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	if (info.st_size > 0) {
+		void * data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+		m_data = (const char *)data;
+		m_size = (size_t)info.st_size;
+	}
+
+	// The mapping stays valid after the descriptor is closed.
+	::close(fd);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+void MappedFile::close()
+{
+	if (m_data) {
+		munmap((void *)m_data, m_size);
+	}
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
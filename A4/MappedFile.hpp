@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A read-only memory mapping of a whole file.
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Map filename, replacing any previous mapping. Returns false if the
+	// file cannot be opened or mapped; empty files map to size() == 0.
+	bool open(const std::string & filename);
+
+	void close();
+
+	const char * data() const;
+	size_t size() const;
+
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	const char * m_data;
+	size_t m_size;
+
+#ifdef _WIN32
+	void * m_file;
+	void * m_mapping;
+#endif
+};
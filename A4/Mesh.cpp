@@ -1,29 +1,414 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
 
 #include <glm/ext.hpp>
 
 // #include "cs488-framework/ObjFileDecoder.hpp"
 #include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "ObjParser.hpp"
+
+// Layout of a .meshcache file: this header, then the vertices as float
+// triples, the faces as uint32_t index triples and the BVH nodes as stored
+// in memory. nodeSize guards against BVHNode changing between builds.
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t nodeSize;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t vertexCount;
+	uint32_t faceCount;
+	uint32_t nodeCount;
+	uint32_t padding;
+};
+
+static const char MeshCacheMagic[8] = { 'A', '4', 'M', 'E', 'S', 'H', '\0', '\0' };
+// Version 2: faces with slashes and polygons are read properly.
+static const uint32_t MeshCacheVersion = 2;
+
+static int processId()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return (int)getpid();
+#endif
+}
 
-Mesh::Mesh( const std::string& fname )
+Mesh::Mesh( const std::string& fname, TriangleLayout layout )
 	: m_vertices()
 	, m_faces()
+	, m_layout( layout )
+{
+	// Parsing the .obj and building the BVH is slow for big meshes, so the
+	// result is cached next to the .obj and reused while it is unchanged.
+	struct stat info;
+	bool haveSource = stat( fname.c_str(), &info ) == 0;
+	uint64_t sourceSize = haveSource ? (uint64_t)info.st_size : 0;
+	int64_t sourceTime = haveSource ? (int64_t)info.st_mtime : 0;
+	std::string cacheName = fname + ".meshcache";
+
+	if( haveSource && readCache( cacheName, sourceSize, sourceTime ) ) {
+		precomputeEdges();
+		return;
+	}
+
+	ObjMesh obj;
+	std::string error;
+	if( !loadObj( fname, obj, error ) ) {
+		std::cerr << "Could not load mesh " << error << std::endl;
+		return;
+	}
+
+	m_vertices.swap( obj.vertices );
+	m_faces.reserve( obj.triangles.size() / 3 );
+	for( size_t i = 0; i < obj.triangles.size(); i += 3 ) {
+		m_faces.push_back( Triangle( obj.triangles[i], obj.triangles[i + 1], obj.triangles[i + 2] ) );
+	}
+
+	buildBVH();
+
+	if( haveSource ) {
+		writeCache( cacheName, sourceSize, sourceTime );
+	}
+	precomputeEdges();
+}
+
+bool Mesh::readCache( const std::string& cacheName,
+	uint64_t sourceSize, int64_t sourceTime )
 {
-	std::string code;
-	double vx, vy, vz;
-	size_t s1, s2, s3;
-
-	std::ifstream ifs( fname.c_str() );
-	while( ifs >> code ) {
-		if( code == "v" ) {
-			ifs >> vx >> vy >> vz;
-			m_vertices.push_back( glm::vec3( vx, vy, vz ) );
-		} else if( code == "f" ) {
-			ifs >> s1 >> s2 >> s3;
-			m_faces.push_back( Triangle( s1 - 1, s2 - 1, s3 - 1 ) );
+	MappedFile file;
+	if( !file.open( cacheName ) || file.size() < sizeof( MeshCacheHeader ) ) {
+		return false;
+	}
+
+	MeshCacheHeader header;
+	std::memcpy( &header, file.data(), sizeof( header ) );
+	if( std::memcmp( header.magic, MeshCacheMagic, sizeof( header.magic ) ) != 0
+		|| header.version != MeshCacheVersion
+		|| header.nodeSize != sizeof( BVHNode )
+		|| header.sourceSize != sourceSize
+		|| header.sourceTime != sourceTime ) {
+		return false;
+	}
+
+	size_t vertexBytes = size_t( header.vertexCount ) * 3 * sizeof( float );
+	size_t faceBytes = size_t( header.faceCount ) * 3 * sizeof( uint32_t );
+	size_t nodeBytes = size_t( header.nodeCount ) * sizeof( BVHNode );
+	if( file.size() != sizeof( header ) + vertexBytes + faceBytes + nodeBytes ) {
+		return false;
+	}
+
+	const char* data = file.data() + sizeof( header );
+
+	m_vertices.resize( header.vertexCount );
+	std::memcpy( (char*)m_vertices.data(), data, vertexBytes );
+	data += vertexBytes;
+
+	// The file may be damaged or from elsewhere: nothing in it may index
+	// past what it holds.
+	std::vector<uint32_t> indices( 3 * size_t( header.faceCount ) );
+	std::memcpy( indices.data(), data, faceBytes );
+	data += faceBytes;
+	for( uint32_t index : indices ) {
+		if( index >= header.vertexCount ) {
+			m_vertices.clear();
+			return false;
+		}
+	}
+	m_faces.reserve( header.faceCount );
+	for( size_t i = 0; i < indices.size(); i += 3 ) {
+		m_faces.push_back( Triangle( indices[i], indices[i + 1], indices[i + 2] ) );
+	}
+
+	std::vector<BVHNode> nodes( header.nodeCount );
+	std::memcpy( nodes.data(), data, nodeBytes );
+	if( ( nodes.empty() && !m_faces.empty() )
+		|| !m_bvh.assign( nodes.data(), nodes.size(), m_faces.size() ) ) {
+		m_vertices.clear();
+		m_faces.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void Mesh::writeCache( const std::string& cacheName,
+	uint64_t sourceSize, int64_t sourceTime ) const
+{
+	MeshCacheHeader header;
+	std::memset( &header, 0, sizeof( header ) );
+	std::memcpy( header.magic, MeshCacheMagic, sizeof( header.magic ) );
+	header.version = MeshCacheVersion;
+	header.nodeSize = sizeof( BVHNode );
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.vertexCount = (uint32_t)m_vertices.size();
+	header.faceCount = (uint32_t)m_faces.size();
+	header.nodeCount = (uint32_t)m_bvh.nodes().size();
+
+	std::vector<uint32_t> indices;
+	indices.reserve( 3 * m_faces.size() );
+	for( const Triangle& face : m_faces ) {
+		indices.push_back( (uint32_t)face.v1 );
+		indices.push_back( (uint32_t)face.v2 );
+		indices.push_back( (uint32_t)face.v3 );
+	}
+
+	// Write under a temporary name so that a concurrent or interrupted run
+	// never sees a partial cache. The name is this process's own, so that
+	// render workers loading the same mesh at once do not write into each
+	// other's file. Failing to write it is not an error.
+	std::string temporary = cacheName + "." + std::to_string( processId() ) + ".tmp";
+	{
+		std::ofstream out( temporary.c_str(), std::ios::binary );
+		out.write( (const char*)&header, sizeof( header ) );
+		out.write( (const char*)m_vertices.data(), m_vertices.size() * sizeof( glm::vec3 ) );
+		out.write( (const char*)indices.data(), indices.size() * sizeof( uint32_t ) );
+		out.write( (const char*)m_bvh.nodes().data(), m_bvh.nodes().size() * sizeof( BVHNode ) );
+		if( !out ) {
+			out.close();
+			std::remove( temporary.c_str() );
+			return;
 		}
 	}
+	std::remove( cacheName.c_str() );
+	std::rename( temporary.c_str(), cacheName.c_str() );
+}
+
+void Mesh::buildBVH()
+{
+	std::vector<AABB> faceBounds;
+	faceBounds.reserve( m_faces.size() );
+	for( const Triangle& face : m_faces ) {
+		AABB box;
+		box.extend( m_vertices[face.v1] );
+		box.extend( m_vertices[face.v2] );
+		box.extend( m_vertices[face.v3] );
+		faceBounds.push_back( box );
+	}
+
+	std::vector<uint32_t> order = m_bvh.build( faceBounds );
+
+	std::vector<Triangle> faces;
+	faces.reserve( m_faces.size() );
+	for( uint32_t index : order ) {
+		faces.push_back( m_faces[index] );
+	}
+	m_faces.swap( faces );
+}
+
+void Mesh::precomputeEdges()
+{
+	if( m_layout != TriangleLayout::Precomputed ) {
+		return;
+	}
+
+	size_t padded = m_faces.size() + simd::Width - 1;
+	for( int axis = 0; axis < 3; ++axis ) {
+		m_edges.p0[axis].assign( padded, 0.0f );
+		m_edges.e1[axis].assign( padded, 0.0f );
+		m_edges.e2[axis].assign( padded, 0.0f );
+	}
+
+	for( size_t i = 0; i < m_faces.size(); ++i ) {
+		const Triangle& face = m_faces[i];
+		const glm::vec3& p0 = m_vertices[face.v1];
+		glm::vec3 e1 = m_vertices[face.v2] - p0;
+		glm::vec3 e2 = m_vertices[face.v3] - p0;
+		for( int axis = 0; axis < 3; ++axis ) {
+			m_edges.p0[axis][i] = p0[axis];
+			m_edges.e1[axis][i] = e1[axis];
+			m_edges.e2[axis][i] = e2[axis];
+		}
+	}
+
+	// The BVH holds the bounds, and nothing else needs these now.
+	std::vector<glm::vec3>().swap( m_vertices );
+	std::vector<Triangle>().swap( m_faces );
+}
+
+// Moller-Trumbore ray/triangle intersection.
+bool Mesh::intersectFace( const Triangle& face, const Ray& ray,
+	float tMin, Intersection& hit ) const
+{
+	const glm::vec3& p0 = m_vertices[face.v1];
+	glm::vec3 e1 = m_vertices[face.v2] - p0;
+	glm::vec3 e2 = m_vertices[face.v3] - p0;
+
+	glm::vec3 p = glm::cross( ray.direction, e2 );
+	float det = glm::dot( e1, p );
+	if( det == 0.0f ) {
+		return false;
+	}
+	float invDet = 1.0f / det;
+
+	glm::vec3 s = ray.origin - p0;
+	float u = glm::dot( s, p ) * invDet;
+	if( u < 0.0f || u > 1.0f ) {
+		return false;
+	}
+
+	glm::vec3 q = glm::cross( s, e1 );
+	float v = glm::dot( ray.direction, q ) * invDet;
+	if( v < 0.0f || u + v > 1.0f ) {
+		return false;
+	}
+
+	float t = glm::dot( e2, q ) * invDet;
+	if( t <= tMin || t >= hit.t ) {
+		return false;
+	}
+
+	hit.t = t;
+	hit.normal = glm::cross( e1, e2 );
+	return true;
+}
+
+// intersectFace() across simd::Width triangles, with the same arithmetic
+// in the same order so that the hits match it exactly.
+bool Mesh::intersectEdges( uint32_t first, uint32_t count, const Ray& ray,
+	float tMin, Intersection& hit ) const
+{
+	using namespace simd;
+
+	Float e1x = Float::load( &m_edges.e1[0][first] );
+	Float e1y = Float::load( &m_edges.e1[1][first] );
+	Float e1z = Float::load( &m_edges.e1[2][first] );
+	Float e2x = Float::load( &m_edges.e2[0][first] );
+	Float e2y = Float::load( &m_edges.e2[1][first] );
+	Float e2z = Float::load( &m_edges.e2[2][first] );
+	Float dx( ray.direction.x ), dy( ray.direction.y ), dz( ray.direction.z );
+
+	Float px = dy * e2z - e2y * dz;
+	Float py = dz * e2x - e2z * dx;
+	Float pz = dx * e2y - e2x * dy;
+	Float det = e1x * px + e1y * py + e1z * pz;
+	Float invDet = Float( 1.0f ) / det;
+
+	Float sx = Float( ray.origin.x ) - Float::load( &m_edges.p0[0][first] );
+	Float sy = Float( ray.origin.y ) - Float::load( &m_edges.p0[1][first] );
+	Float sz = Float( ray.origin.z ) - Float::load( &m_edges.p0[2][first] );
+	Float u = ( sx * px + sy * py + sz * pz ) * invDet;
+
+	// Lanes past count hold the next leaf's triangles or padding.
+	Mask valid = andNot( Float::lanes() < Float( float( count ) ), det == Float( 0.0f ) )
+		& ( u >= Float( 0.0f ) ) & ( u <= Float( 1.0f ) );
+	if( none( valid ) ) {
+		return false;
+	}
+
+	Float qx = sy * e1z - e1y * sz;
+	Float qy = sz * e1x - e1z * sx;
+	Float qz = sx * e1y - e1x * sy;
+	Float v = ( dx * qx + dy * qy + dz * qz ) * invDet;
+	Float t = ( e2x * qx + e2y * qy + e2z * qz ) * invDet;
+
+	int accepted = bits( valid & ( v >= Float( 0.0f ) ) & ( u + v <= Float( 1.0f ) )
+		& ( t > Float( tMin ) ) & ( t < Float( hit.t ) ) );
+	if( accepted == 0 ) {
+		return false;
+	}
+
+	// The nearest, and of equally near ones the first, as testing them in
+	// order would find.
+	float ts[Width];
+	t.store( ts );
+	int best = -1;
+	for( int lane = 0; lane < Width; ++lane ) {
+		if( ( accepted >> lane & 1 ) && ( best < 0 || ts[lane] < ts[best] ) ) {
+			best = lane;
+		}
+	}
+
+	uint32_t i = first + best;
+	glm::vec3 e1( m_edges.e1[0][i], m_edges.e1[1][i], m_edges.e1[2][i] );
+	glm::vec3 e2( m_edges.e2[0][i], m_edges.e2[1][i], m_edges.e2[2][i] );
+	hit.t = ts[best];
+	hit.normal = glm::cross( e1, e2 );
+	return true;
+}
+
+bool Mesh::intersect( const Ray& ray, float tMin, Intersection& hit ) const
+{
+	return intersect( ray, tMin, hit, nullptr );
+}
+
+bool Mesh::intersect( const Ray& ray, float tMin, Intersection& hit,
+	TraceStats* stats ) const
+{
+	if( m_layout == TriangleLayout::Precomputed ) {
+		return m_bvh.intersectLeaves( ray, tMin, hit, [&]( uint32_t offset, uint32_t count ) {
+			bool found = false;
+			for( uint32_t i = offset; i < offset + count; i += simd::Width ) {
+				if( intersectEdges( i, std::min<uint32_t>( count - ( i - offset ), simd::Width ),
+					ray, tMin, hit ) ) {
+					found = true;
+				}
+			}
+			return found;
+		}, stats );
+	}
+	return m_bvh.intersect( ray, tMin, hit, [&]( uint32_t i ) {
+		return intersectFace( m_faces[i], ray, tMin, hit );
+	}, stats );
+}
+
+bool Mesh::occluded( const Ray& ray, float tMin, float tMax,
+	TraceStats* stats ) const
+{
+	if( m_layout == TriangleLayout::Precomputed ) {
+		return m_bvh.occludedLeaves( ray, tMin, tMax, [&]( uint32_t offset, uint32_t count ) {
+			for( uint32_t i = offset; i < offset + count; i += simd::Width ) {
+				Intersection hit( tMax );
+				if( intersectEdges( i, std::min<uint32_t>( count - ( i - offset ), simd::Width ),
+					ray, tMin, hit ) ) {
+					return true;
+				}
+			}
+			return false;
+		}, stats );
+	}
+	return m_bvh.occluded( ray, tMin, tMax, [&]( uint32_t i ) {
+		Intersection hit( tMax );
+		return intersectFace( m_faces[i], ray, tMin, hit );
+	}, stats );
+}
+
+simd::Mask Mesh::intersect( const RayPacket& packet, float tMin,
+	PacketIntersection& hit, TraceStats* stats ) const
+{
+	if( m_layout == TriangleLayout::Precomputed ) {
+		return m_bvh.intersect( packet, tMin, hit, [&]( uint32_t i ) {
+			const TriangleEdges& edges = m_edges;
+			return intersectTriangleEdges( packet,
+				glm::vec3( edges.p0[0][i], edges.p0[1][i], edges.p0[2][i] ),
+				glm::vec3( edges.e1[0][i], edges.e1[1][i], edges.e1[2][i] ),
+				glm::vec3( edges.e2[0][i], edges.e2[1][i], edges.e2[2][i] ), tMin, hit );
+		}, stats );
+	}
+	return m_bvh.intersect( packet, tMin, hit, [&]( uint32_t i ) {
+		const Triangle& face = m_faces[i];
+		return intersectTriangle( packet, m_vertices[face.v1],
+			m_vertices[face.v2], m_vertices[face.v3], tMin, hit );
+	}, stats );
+}
+
+AABB Mesh::bounds() const
+{
+	return m_bvh.bounds();
 }
 
 std::ostream& operator<<(std::ostream& out, const Mesh& mesh)
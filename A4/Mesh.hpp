@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <iosfwd>
 #include <string>
@@ -7,6 +8,7 @@
 #include <glm/glm.hpp>
 
 #include "Primitive.hpp"
+#include "BVH.hpp"
 
 struct Triangle
 {
@@ -21,14 +23,80 @@ struct Triangle
 	{}
 };
 
+// How a mesh keeps its triangles for intersection. Precomputed stores each
+// triangle's first vertex and two edges, a coordinate per array, in BVH
+// leaf order, so a leaf's triangles are tested together with SIMD and no
+// indirection: 36 bytes a triangle. Indexed keeps the vertices and index
+// triples as read, typically around 30 bytes a triangle, and tests one
+// triangle at a time.
+enum class TriangleLayout : uint8_t {
+	Precomputed,
+	Indexed
+};
+
+// The precomputed layout: vertex p0 and edges e1 = p1 - p0 and
+// e2 = p2 - p0 of every triangle, padded with degenerate triangles so that
+// simd::Width of them can be loaded from any index.
+struct TriangleEdges
+{
+	std::vector<float> p0[3];
+	std::vector<float> e1[3];
+	std::vector<float> e2[3];
+};
+
 // A polygonal mesh.
 class Mesh : public Primitive {
 public:
-  Mesh( const std::string& fname );
+  Mesh( const std::string& fname,
+    TriangleLayout layout = TriangleLayout::Precomputed );
+
+  virtual bool intersect( const Ray& ray, float tMin, Intersection& hit ) const;
+  virtual AABB bounds() const;
+
+  // As intersect() above, counting the work into stats if given.
+  bool intersect( const Ray& ray, float tMin, Intersection& hit,
+    TraceStats* stats ) const;
+
+  // Whether any face is hit between tMin and tMax, stopping at the first.
+  bool occluded( const Ray& ray, float tMin, float tMax,
+    TraceStats* stats = nullptr ) const;
+
+  // Intersect every active lane of a packet given in model space.
+  simd::Mask intersect( const RayPacket& packet, float tMin,
+    PacketIntersection& hit, TraceStats* stats = nullptr ) const;
   
 private:
+	// Build m_bvh over the faces and put m_faces in BVH leaf order.
+	void buildBVH();
+
+	// Load the vertices, faces and BVH from the binary cache at cacheName,
+	// provided it was written for a source file of the given size and
+	// modification time. Returns false, leaving the mesh empty, otherwise.
+	bool readCache( const std::string& cacheName,
+		uint64_t sourceSize, int64_t sourceTime );
+	void writeCache( const std::string& cacheName,
+		uint64_t sourceSize, int64_t sourceTime ) const;
+
+	// Fill m_edges from the vertices and faces, then free those.
+	void precomputeEdges();
+
+	bool intersectFace( const Triangle& face, const Ray& ray,
+		float tMin, Intersection& hit ) const;
+
+	// Intersect triangles [first, first + count) of m_edges, count at most
+	// simd::Width, all at once. Gives the same hit as intersectFace() on
+	// each in turn.
+	bool intersectEdges( uint32_t first, uint32_t count, const Ray& ray,
+		float tMin, Intersection& hit ) const;
+
+	// Empty in the precomputed layout, once m_edges is filled.
 	std::vector<glm::vec3> m_vertices;
 	std::vector<Triangle> m_faces;
 
+	TriangleLayout m_layout;
+	TriangleEdges m_edges;
+
+	BVH m_bvh;
+
     friend std::ostream& operator<<(std::ostream& out, const Mesh& mesh);
 };
@@ -0,0 +1,267 @@
+#include "ObjParser.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "MappedFile.hpp"
+
+// Powers of ten a double holds exactly.
+static const double ExactPowersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int MaxExactPowerOf10 = 22;
+
+// Integers up to this are exact in a double.
+static const uint64_t MaxExactMantissa = uint64_t(1) << 53;
+
+//---------------------------------------------------------------------------------------
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+//---------------------------------------------------------------------------------------
+// Spaces within a line; '\r' counts, so CRLF files need no special case.
+static bool isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+//---------------------------------------------------------------------------------------
+static void skipBlanks(const char *& p, const char * end)
+{
+	while (p < end && isBlank(*p)) {
+		++p;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// Whether p is at the end of a number or index: a blank, the end of the
+// line or the end of the data.
+static bool atSeparator(const char * p, const char * end)
+{
+	return p == end || isBlank(*p) || *p == '\n';
+}
+
+//---------------------------------------------------------------------------------------
+// Parse a decimal number at p, advancing past it. Up to 19 significant
+// digits and a power of ten up to 22 are converted exactly with a single
+// rounding, giving the same double as strtod(); anything longer or
+// larger, which .obj exporters rarely write, is handed to strtod().
+static bool parseNumber(const char *& p, const char * end, double & value)
+{
+	const char * start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+	bool truncated = false;
+
+	for (; p < end && isDigit(*p); ++p) {
+		anyDigits = true;
+		if (significantDigits < 19) {
+			mantissa = 10 * mantissa + (*p - '0');
+			significantDigits += mantissa != 0;
+		} else {
+			truncated |= *p != '0';
+			++exponent;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && isDigit(*p); ++p) {
+			anyDigits = true;
+			if (significantDigits < 19) {
+				mantissa = 10 * mantissa + (*p - '0');
+				significantDigits += mantissa != 0;
+				--exponent;
+			} else {
+				truncated |= *p != '0';
+			}
+		}
+	}
+	if (!anyDigits) {
+		return false;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negativeExponent = *p == '-';
+			++p;
+		}
+		if (p == end || !isDigit(*p)) {
+			return false;
+		}
+		int written = 0;
+		for (; p < end && isDigit(*p); ++p) {
+			// Past this the value is 0 or infinite anyway.
+			if (written < 100000) {
+				written = 10 * written + (*p - '0');
+			}
+		}
+		exponent += negativeExponent ? -written : written;
+	}
+	if (!atSeparator(p, end)) {
+		return false;
+	}
+
+	if (!truncated && mantissa <= MaxExactMantissa
+		&& exponent >= -MaxExactPowerOf10 && exponent <= MaxExactPowerOf10) {
+		value = (double)mantissa;
+		value = exponent < 0 ? value / ExactPowersOf10[-exponent]
+		                     : value * ExactPowersOf10[exponent];
+		value = negative ? -value : value;
+		return true;
+	}
+
+	// The data need not be null terminated, so strtod() gets a copy.
+	std::string text(start, p);
+	value = std::strtod(text.c_str(), nullptr);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+static bool parseIndex(const char *& p, const char * end, long long & index)
+{
+	bool negative = p < end && *p == '-';
+	if (negative) {
+		++p;
+	}
+	if (p == end || !isDigit(*p)) {
+		return false;
+	}
+
+	long long value = 0;
+	for (; p < end && isDigit(*p); ++p) {
+		if (value < (1LL << 40)) {
+			value = 10 * value + (*p - '0');
+		}
+	}
+	index = negative ? -value : value;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// One vertex of a face: v, v/vt, v//vn or v/vt/vn. Returns the 0-based
+// position index, not yet range checked against later vertices.
+static bool parseFaceVertex(const char *& p, const char * end, size_t vertexCount,
+	long long & vertex)
+{
+	long long index;
+	if (!parseIndex(p, end, index) || index == 0) {
+		return false;
+	}
+	// Negative indices are relative to the vertices so far.
+	vertex = index > 0 ? index - 1 : (long long)vertexCount + index;
+	if (vertex < 0) {
+		return false;
+	}
+
+	for (int slashes = 0; slashes < 2 && p < end && *p == '/'; ++slashes) {
+		++p;
+		long long ignored;
+		if (p < end && *p != '/' && !atSeparator(p, end) && !parseIndex(p, end, ignored)) {
+			return false;
+		}
+	}
+	return atSeparator(p, end);
+}
+
+//---------------------------------------------------------------------------------------
+bool parseObj(const char * data, size_t size, ObjMesh & mesh, std::string & error)
+{
+	const char * p = data;
+	const char * end = data + size;
+	size_t line = 0;
+
+	auto fail = [&](const char * what) {
+		error = "line " + std::to_string(line) + ": " + what;
+		return false;
+	};
+
+	// Indices seen in a face before the vertex they name is tolerated and
+	// checked at the end.
+	long long largestIndex = -1;
+	std::vector<uint32_t> polygon;
+
+	while (p < end) {
+		++line;
+		skipBlanks(p, end);
+
+		bool vertex = end - p >= 2 && p[0] == 'v' && isBlank(p[1]);
+		bool face = end - p >= 2 && p[0] == 'f' && isBlank(p[1]);
+
+		if (vertex) {
+			p += 2;
+			double xyz[3];
+			for (int i = 0; i < 3; ++i) {
+				skipBlanks(p, end);
+				if (!parseNumber(p, end, xyz[i])) {
+					return fail("vertex needs three numbers");
+				}
+			}
+			mesh.vertices.push_back(glm::vec3(xyz[0], xyz[1], xyz[2]));
+		} else if (face) {
+			p += 2;
+			polygon.clear();
+			for (skipBlanks(p, end); p < end && *p != '\n' && *p != '#'; skipBlanks(p, end)) {
+				long long index;
+				if (!parseFaceVertex(p, end, mesh.vertices.size(), index)) {
+					return fail("bad face vertex");
+				}
+				if (index > UINT32_MAX) {
+					return fail("face vertex index out of range");
+				}
+				largestIndex = std::max(largestIndex, index);
+				polygon.push_back((uint32_t)index);
+			}
+			if (polygon.size() < 3) {
+				return fail("face needs at least three vertices");
+			}
+			for (size_t i = 2; i < polygon.size(); ++i) {
+				mesh.triangles.push_back(polygon[0]);
+				mesh.triangles.push_back(polygon[i - 1]);
+				mesh.triangles.push_back(polygon[i]);
+			}
+		}
+
+		// Whatever is left: the rest of a vertex line (e.g. a w coordinate
+		// or colour), or a line of a kind that is not read at all.
+		while (p < end && *p != '\n') {
+			++p;
+		}
+		if (p < end) {
+			++p;
+		}
+	}
+
+	if (largestIndex >= (long long)mesh.vertices.size()) {
+		error = "face vertex " + std::to_string(largestIndex + 1) + " of only "
+			+ std::to_string(mesh.vertices.size());
+		return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+bool loadObj(const std::string & filename, ObjMesh & mesh, std::string & error)
+{
+	MappedFile file;
+	if (!file.open(filename)) {
+		error = filename + ": cannot open";
+		return false;
+	}
+	if (!parseObj(file.data(), file.size(), mesh, error)) {
+		error = filename + ": " + error;
+		return false;
+	}
+	return true;
+}
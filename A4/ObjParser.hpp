@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// The geometry of a Wavefront .obj file.
+struct ObjMesh {
+	std::vector<glm::vec3> vertices;
+
+	// Three 0-based vertex indices per triangle.
+	std::vector<uint32_t> triangles;
+};
+
+// Parse the .obj text in [data, data + size) into mesh, in one pass and
+// without copying it. Only vertex positions ("v") and faces ("f") are read;
+// every other kind of line is skipped. Face vertices may be written v,
+// v/vt, v//vn or v/vt/vn (only v is used) and negative indices count back
+// from the last vertex read. Polygons are split into triangle fans.
+//
+// Numbers parse to exactly what strtod() would give. On a malformed line,
+// returns false with its line number and what is wrong in error.
+bool parseObj(const char * data, size_t size, ObjMesh & mesh, std::string & error);
+
+// parseObj() over filename, memory mapped. Errors start with the filename.
+bool loadObj(const std::string & filename, ObjMesh & mesh, std::string & error);
@@ -1,11 +1,45 @@
 #include "PhongMaterial.hpp"
 
 PhongMaterial::PhongMaterial(
-	const glm::vec3& kd, const glm::vec3& ks, double shininess )
+	const glm::vec3& kd, const glm::vec3& ks, double shininess,
+	double reflectivity, double transparency, double refractiveIndex )
 	: m_kd(kd)
 	, m_ks(ks)
 	, m_shininess(shininess)
+	, m_reflectivity(reflectivity)
+	, m_transparency(transparency)
+	, m_refractiveIndex(refractiveIndex)
 {}
 
 PhongMaterial::~PhongMaterial()
 {}
+
+const glm::vec3& PhongMaterial::kd() const
+{
+	return m_kd;
+}
+
+const glm::vec3& PhongMaterial::ks() const
+{
+	return m_ks;
+}
+
+double PhongMaterial::shininess() const
+{
+	return m_shininess;
+}
+
+double PhongMaterial::reflectivity() const
+{
+	return m_reflectivity;
+}
+
+double PhongMaterial::transparency() const
+{
+	return m_transparency;
+}
+
+double PhongMaterial::refractiveIndex() const
+{
+	return m_refractiveIndex;
+}
@@ -4,14 +4,33 @@
 
 #include "Material.hpp"
 
+// Phong shading, optionally mixed with a mirror reflection and with
+// refraction through a dielectric (glass, water):
+//
+//   reflectivity: fraction of the light off an opaque surface that comes
+//     from the mirror direction rather than from the Phong model.
+//   transparency: fraction of the surface that is a dielectric, splitting
+//     its light between reflection and refraction by the Fresnel term.
+//   refractiveIndex: of the dielectric, relative to the space outside it.
 class PhongMaterial : public Material {
 public:
-  PhongMaterial(const glm::vec3& kd, const glm::vec3& ks, double shininess);
+  PhongMaterial(const glm::vec3& kd, const glm::vec3& ks, double shininess,
+    double reflectivity = 0.0, double transparency = 0.0, double refractiveIndex = 1.0);
   virtual ~PhongMaterial();
 
+  const glm::vec3& kd() const;
+  const glm::vec3& ks() const;
+  double shininess() const;
+  double reflectivity() const;
+  double transparency() const;
+  double refractiveIndex() const;
+
 private:
   glm::vec3 m_kd;
   glm::vec3 m_ks;
 
   double m_shininess;
+  double m_reflectivity;
+  double m_transparency;
+  double m_refractiveIndex;
 };
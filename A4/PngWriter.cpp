@@ -0,0 +1,369 @@
+#include "PngWriter.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <lodepng/lodepng.h>
+
+#include "ThreadPool.hpp"
+
+// Compressed data is written in IDAT chunks of about this size.
+static const size_t DataChunkSize = 1 << 16;
+
+// writePngParallel compresses stripes of about this many filtered bytes
+// each. Every stripe starts without the previous one's history, so smaller
+// stripes spread better over threads but compress a little worse.
+static const size_t StripeSize = 1 << 18;
+
+//---------------------------------------------------------------------------------------
+static void putUint32(unsigned char * out, uint32_t value)
+{
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+//---------------------------------------------------------------------------------------
+static unsigned char paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return (unsigned char)a;
+	}
+	return (unsigned char)(pb <= pc ? b : c);
+}
+
+//---------------------------------------------------------------------------------------
+static void writeChunk(std::ostream & file, const char * type,
+	const unsigned char * data, size_t size)
+{
+	std::vector<unsigned char> chunk(12 + size);
+	putUint32(&chunk[0], (uint32_t)size);
+	std::copy(type, type + 4, chunk.begin() + 4);
+	if (size > 0) {
+		std::copy(data, data + size, chunk.begin() + 8);
+	}
+	// The CRC covers the type and the data.
+	putUint32(&chunk[8 + size], lodepng_crc32(&chunk[4], 4 + size));
+	file.write((const char *)chunk.data(), chunk.size());
+}
+
+//---------------------------------------------------------------------------------------
+// The signature and IHDR chunk of an 8-bit RGB image.
+static void writeHeader(std::ostream & file, uint width, uint height)
+{
+	static const unsigned char Signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	file.write((const char *)Signature, sizeof(Signature));
+
+	unsigned char header[13];
+	putUint32(header, width);
+	putUint32(header + 4, height);
+	header[8] = 8;  // bits per channel
+	header[9] = 2;  // RGB
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering
+	header[12] = 0; // not interlaced
+	writeChunk(file, "IHDR", header, sizeof(header));
+}
+
+//---------------------------------------------------------------------------------------
+// Filters the row all five ways into scratch, 5 * (stride + 1) bytes, and
+// returns the one with the smallest sum of absolute (signed) differences,
+// the usual heuristic and lodepng's default: stride + 1 bytes starting with
+// the filter type. up is the previous row, or zeros for the first.
+static const unsigned char * filterRow(const unsigned char * rgb, const unsigned char * up,
+	size_t stride, unsigned char * scratch)
+{
+	const size_t Bpp = 3;
+
+	size_t bestFilter = 0;
+	size_t bestSum = size_t(-1);
+	for (size_t filter = 0; filter < 5; ++filter) {
+		unsigned char * out = &scratch[filter * (stride + 1)];
+		out[0] = (unsigned char)filter;
+		size_t sum = 0;
+
+		for (size_t i = 0; i < stride; ++i) {
+			int a = i >= Bpp ? rgb[i - Bpp] : 0;
+			int b = up[i];
+			int c = i >= Bpp ? up[i - Bpp] : 0;
+
+			unsigned char predicted = 0;
+			switch (filter) {
+				case 1: predicted = (unsigned char)a; break;
+				case 2: predicted = (unsigned char)b; break;
+				case 3: predicted = (unsigned char)((a + b) / 2); break;
+				case 4: predicted = paeth(a, b, c); break;
+			}
+
+			unsigned char value = (unsigned char)(rgb[i] - predicted);
+			out[i + 1] = value;
+			sum += value < 128 ? value : 256 - value;
+		}
+
+		if (sum < bestSum) {
+			bestSum = sum;
+			bestFilter = filter;
+		}
+	}
+
+	return &scratch[bestFilter * (stride + 1)];
+}
+
+//---------------------------------------------------------------------------------------
+PngWriter::PngWriter()
+	: m_width(0),
+	  m_height(0),
+	  m_rows(0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+bool PngWriter::open(const std::string & filename, uint width, uint height)
+{
+	m_file.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if (!m_file) {
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_rows = 0;
+	m_previous.assign(3 * size_t(width), 0);
+	m_filtered.resize(5 * (1 + 3 * size_t(width)));
+	m_data.clear();
+	m_deflate.reset(new DeflateStream([this](const unsigned char * data, size_t size) {
+		m_data.insert(m_data.end(), data, data + size);
+	}));
+
+	writeHeader(m_file, width, height);
+
+	return bool(m_file);
+}
+
+//---------------------------------------------------------------------------------------
+void PngWriter::writeRow(const unsigned char * rgb)
+{
+	size_t stride = 3 * size_t(m_width);
+	m_deflate->write(filterRow(rgb, m_previous.data(), stride, m_filtered.data()), stride + 1);
+	std::copy(rgb, rgb + stride, m_previous.begin());
+	++m_rows;
+
+	flushData(false);
+}
+
+//---------------------------------------------------------------------------------------
+bool PngWriter::close()
+{
+	if (!m_deflate) {
+		return false;
+	}
+
+	m_deflate->finish();
+	m_deflate.reset();
+	flushData(true);
+	writeChunk(m_file, "IEND", nullptr, 0);
+	m_file.close();
+
+	return m_rows == m_height && !m_file.fail();
+}
+
+//---------------------------------------------------------------------------------------
+void PngWriter::flushData(bool all)
+{
+	size_t written = 0;
+	while (m_data.size() - written >= DataChunkSize
+		|| (all && written < m_data.size())) {
+		size_t size = std::min(DataChunkSize, m_data.size() - written);
+		writeChunk(m_file, "IDAT", &m_data[written], size);
+		written += size;
+	}
+	m_data.erase(m_data.begin(), m_data.begin() + written);
+}
+
+//---------------------------------------------------------------------------------------
+StreamingPngWriter::StreamingPngWriter(const std::string & filename,
+	uint width, uint height, uint bandHeight)
+	: m_good(false),
+	  m_width(width),
+	  m_height(height),
+	  m_bandHeight(std::max(1u, bandHeight)),
+	  m_nextBand(0),
+	  m_writing(false),
+	  m_peakBands(0)
+{
+	m_good = m_png.open(filename, width, height);
+}
+
+//---------------------------------------------------------------------------------------
+bool StreamingPngWriter::good() const
+{
+	return m_good;
+}
+
+//---------------------------------------------------------------------------------------
+size_t StreamingPngWriter::peakBands() const
+{
+	return m_peakBands;
+}
+
+//---------------------------------------------------------------------------------------
+StreamingPngWriter::Band & StreamingPngWriter::band(uint index)
+{
+	auto found = m_bands.find(index);
+	if (found != m_bands.end()) {
+		return found->second;
+	}
+
+	uint rows = std::min(m_bandHeight, m_height - index * m_bandHeight);
+	Band & created = m_bands[index];
+	created.rgb.resize(3 * size_t(m_width) * rows);
+	created.pixelsLeft = size_t(m_width) * rows;
+	m_peakBands = std::max(m_peakBands, m_bands.size());
+	return created;
+}
+
+//---------------------------------------------------------------------------------------
+void StreamingPngWriter::writeBlock(uint x0, uint y0, uint width, uint height,
+	const float * rgb)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (uint y = 0; y < height; ++y) {
+		uint row = y0 + y;
+		Band & target = band(row / m_bandHeight);
+		unsigned char * out = &target.rgb[3 * (size_t(row % m_bandHeight) * m_width + x0)];
+		const float * in = rgb + 3 * size_t(y) * width;
+
+		for (uint i = 0; i < 3 * width; ++i) {
+			double colour = std::min(1.0, std::max(0.0, double(in[i])));
+			out[i] = (unsigned char)(255 * colour);
+		}
+		target.pixelsLeft -= width;
+	}
+
+	// Whoever finds the next band complete writes it, and any after it
+	// that are complete by then, without holding up the other threads.
+	if (m_writing) {
+		return;
+	}
+	m_writing = true;
+
+	for (;;) {
+		auto next = m_bands.find(m_nextBand);
+		if (next == m_bands.end() || next->second.pixelsLeft > 0) {
+			break;
+		}
+
+		std::vector<unsigned char> rgbRows;
+		rgbRows.swap(next->second.rgb);
+		m_bands.erase(next);
+		++m_nextBand;
+
+		lock.unlock();
+		size_t stride = 3 * size_t(m_width);
+		for (size_t offset = 0; offset < rgbRows.size(); offset += stride) {
+			m_png.writeRow(&rgbRows[offset]);
+		}
+		lock.lock();
+	}
+
+	m_writing = false;
+}
+
+//---------------------------------------------------------------------------------------
+bool StreamingPngWriter::finish()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_good && m_png.close();
+}
+
+//---------------------------------------------------------------------------------------
+bool writePngParallel(const std::string & filename, uint width, uint height,
+	const PngRowSource & rows, unsigned int threadCount)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	size_t stride = 3 * size_t(width);
+	uint stripeRows = (uint)std::max<size_t>(1, StripeSize / (stride + 1));
+	size_t stripeCount = height == 0 ? 0 : (height + stripeRows - 1) / stripeRows;
+
+	struct Stripe {
+		std::vector<unsigned char> data;
+		uint32_t adler;
+		uint64_t size;
+	};
+	std::vector<Stripe> stripes(stripeCount);
+
+	auto encodeStripe = [&](size_t index) {
+		uint y0 = uint(index) * stripeRows;
+		uint y1 = std::min(height, y0 + stripeRows);
+		Stripe & stripe = stripes[index];
+
+		// Filters look one row up, into the previous stripe.
+		std::vector<unsigned char> previous(stride, 0);
+		std::vector<unsigned char> current(stride);
+		std::vector<unsigned char> scratch(5 * (stride + 1));
+		if (y0 > 0) {
+			rows(y0 - 1, previous.data());
+		}
+
+		DeflateStream deflate([&stripe](const unsigned char * data, size_t size) {
+			stripe.data.insert(stripe.data.end(), data, data + size);
+		}, DeflateStream::Framing::Raw);
+
+		for (uint y = y0; y < y1; ++y) {
+			rows(y, current.data());
+			deflate.write(filterRow(current.data(), previous.data(), stride, scratch.data()),
+				stride + 1);
+			previous.swap(current);
+		}
+
+		deflate.finish(index + 1 == stripeCount);
+		stripe.adler = deflate.adler32();
+		stripe.size = uint64_t(y1 - y0) * (stride + 1);
+	};
+
+	if (threadCount == 1 || stripeCount <= 1) {
+		for (size_t i = 0; i < stripeCount; ++i) {
+			encodeStripe(i);
+		}
+	} else {
+		ThreadPool pool(threadCount);
+		pool.parallelFor(stripeCount, [&](unsigned int, size_t item) {
+			encodeStripe(item);
+		});
+	}
+
+	writeHeader(file, width, height);
+
+	// zlib header, the stripes in order, then the checksum of them all.
+	std::vector<unsigned char> data = { 0x78, 0x01 };
+	uint32_t adler = 1;
+	for (Stripe & stripe : stripes) {
+		data.insert(data.end(), stripe.data.begin(), stripe.data.end());
+		std::vector<unsigned char>().swap(stripe.data);
+		adler = DeflateStream::combineAdler32(adler, stripe.adler, stripe.size);
+
+		size_t written = 0;
+		while (data.size() - written >= DataChunkSize) {
+			writeChunk(file, "IDAT", &data[written], DataChunkSize);
+			written += DataChunkSize;
+		}
+		data.erase(data.begin(), data.begin() + written);
+	}
+	unsigned char checksum[4];
+	putUint32(checksum, adler);
+	data.insert(data.end(), checksum, checksum + 4);
+	writeChunk(file, "IDAT", data.data(), data.size());
+
+	writeChunk(file, "IEND", nullptr, 0);
+	file.close();
+	return !file.fail();
+}
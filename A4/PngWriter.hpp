@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Deflate.hpp"
+#include "Image.hpp"
+
+/**
+ * Writes an 8-bit RGB PNG a row at a time. Rows are filtered, compressed
+ * and written out as they arrive, so only the previous row and the
+ * compressor's window are kept in memory.
+ */
+class PngWriter {
+public:
+	PngWriter();
+
+	// Create filename and write the header. Returns false if the file
+	// cannot be created.
+	bool open(const std::string & filename, uint width, uint height);
+
+	// Append the next row, width RGB triples.
+	void writeRow(const unsigned char * rgb);
+
+	// Finish the file once every row has been written. Returns false if
+	// anything could not be written.
+	bool close();
+
+private:
+	PngWriter(const PngWriter &) = delete;
+	PngWriter & operator=(const PngWriter &) = delete;
+
+	void flushData(bool all);
+
+	std::ofstream m_file;
+	std::unique_ptr<DeflateStream> m_deflate;
+	uint m_width;
+	uint m_height;
+	uint m_rows;
+
+	std::vector<unsigned char> m_previous;
+	std::vector<unsigned char> m_filtered;
+	std::vector<unsigned char> m_data;
+};
+
+/**
+ * Streams a PNG from blocks of float pixels (e.g. render tiles) finishing
+ * in any order and on any thread. Blocks must tile the image in bands of
+ * bandHeight rows; as soon as the topmost unwritten band is complete it is
+ * converted, compressed and written, and its memory released, so only the
+ * bands still being rendered are held.
+ */
+class StreamingPngWriter {
+public:
+	StreamingPngWriter(const std::string & filename, uint width, uint height,
+		uint bandHeight);
+
+	bool good() const;
+
+	// Add the block [x0, x0 + width) x [y0, y0 + height), given as rows of
+	// RGB triples. Colours are clamped to [0, 1] as in Image::savePng.
+	void writeBlock(uint x0, uint y0, uint width, uint height, const float * rgb);
+
+	// Write the end of the file. Every pixel must have been written.
+	bool finish();
+
+	// Largest number of bands that were held at once.
+	size_t peakBands() const;
+
+private:
+	struct Band {
+		std::vector<unsigned char> rgb;
+		size_t pixelsLeft;
+	};
+
+	Band & band(uint index);
+
+	PngWriter m_png;
+	bool m_good;
+	uint m_width;
+	uint m_height;
+	uint m_bandHeight;
+
+	std::mutex m_mutex;
+	std::map<uint, Band> m_bands;
+	uint m_nextBand;
+	bool m_writing;
+	size_t m_peakBands;
+};
+
+// Fills rgb with row y of an image, width 8-bit RGB triples.
+typedef std::function<void(uint y, unsigned char * rgb)> PngRowSource;
+
+// Encode a whole image as a PNG file on threadCount threads (0 for one per
+// hardware thread). As in pigz, the rows are split into stripes of a fixed
+// size that are filtered and compressed independently, each ending in a
+// sync flush, and then joined into one zlib stream with the checksums
+// combined. Rows are fetched from rows, from any thread, a stripe at a time.
+// The output does not depend on the number of threads.
+bool writePngParallel(const std::string & filename, uint width, uint height,
+	const PngRowSource & rows, unsigned int threadCount = 0);
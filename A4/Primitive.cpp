@@ -1,21 +1,167 @@
 #include "Primitive.hpp"
 
+#include <cmath>
+
+//---------------------------------------------------------------------------------------
+// Closest root of |origin + t * direction - centre|^2 = radius^2 in (tMin, hit.t).
+bool intersectSphere(const Ray& ray, const glm::vec3& centre, float radius,
+  float tMin, Intersection& hit)
+{
+  return intersectSphereSquared(ray, centre, double(radius) * radius, tMin, hit);
+}
+
+//---------------------------------------------------------------------------------------
+// The quadratic solved as quadraticRoots() would, in terms of half of its B
+// coefficient, which gives the same roots to the bit: every factor of two
+// dropped is exact.
+bool intersectSphereSquared(const Ray& ray, const glm::vec3& centre, double radiusSquared,
+  float tMin, Intersection& hit)
+{
+  glm::vec3 oc = ray.origin - centre;
+  double halfB = glm::dot(ray.direction, oc);
+  double C = glm::dot(oc, oc) - radiusSquared;
+
+  // Starting outside and heading away: both roots are behind the origin.
+  if (C > 0.0 && halfB > 0.0 && tMin >= 0.0f) {
+    return false;
+  }
+
+  double A = glm::dot(ray.direction, ray.direction);
+  double D = halfB * halfB - A * C;
+  if (D < 0.0) {
+    return false;
+  }
+
+  double q = -(halfB + (halfB < 0.0 ? -1.0 : 1.0) * std::sqrt(D));
+  double roots[2] = { q / A, q != 0.0 ? C / q : q / A };
+
+  bool found = false;
+  for (double root : roots) {
+    float t = float(root);
+    if (t > tMin && t < hit.t) {
+      hit.t = t;
+      found = true;
+    }
+  }
+
+  if (found) {
+    hit.normal = ray.origin + hit.t * ray.direction - centre;
+  }
+  return found;
+}
+
+//---------------------------------------------------------------------------------------
+// Slab test against [min, max], reporting the normal of the face that was hit.
+bool intersectBox(const Ray& ray, const glm::vec3& min, const glm::vec3& max,
+  float tMin, Intersection& hit)
+{
+  float tNear = -std::numeric_limits<float>::infinity();
+  float tFar = std::numeric_limits<float>::infinity();
+  int nearAxis = 0, farAxis = 0;
+
+  for (int a = 0; a < 3; ++a) {
+    float t0 = (min[a] - ray.origin[a]) * ray.invDirection[a];
+    float t1 = (max[a] - ray.origin[a]) * ray.invDirection[a];
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    if (t0 > tNear) {
+      tNear = t0;
+      nearAxis = a;
+    }
+    if (t1 < tFar) {
+      tFar = t1;
+      farAxis = a;
+    }
+  }
+
+  if (tNear > tFar) {
+    return false;
+  }
+
+  // Entering the box, or leaving it if the ray starts inside.
+  float t;
+  int axis;
+  if (tNear > tMin) {
+    t = tNear;
+    axis = nearAxis;
+  } else {
+    t = tFar;
+    axis = farAxis;
+  }
+
+  if (t <= tMin || t >= hit.t) {
+    return false;
+  }
+
+  hit.t = t;
+  hit.normal = glm::vec3(0.0f);
+  hit.normal[axis] = ray.direction[axis] > 0.0f ? -1.0f : 1.0f;
+  return true;
+}
+
+//---------------------------------------------------------------------------------------
 Primitive::~Primitive()
 {
 }
 
+//---------------------------------------------------------------------------------------
 Sphere::~Sphere()
 {
 }
 
+bool Sphere::intersect(const Ray& ray, float tMin, Intersection& hit) const
+{
+  return intersectSphere(ray, glm::vec3(0.0f), 1.0f, tMin, hit);
+}
+
+AABB Sphere::bounds() const
+{
+  return AABB(glm::vec3(-1.0f), glm::vec3(1.0f));
+}
+
+//---------------------------------------------------------------------------------------
 Cube::~Cube()
 {
 }
 
+bool Cube::intersect(const Ray& ray, float tMin, Intersection& hit) const
+{
+  return intersectBox(ray, glm::vec3(0.0f), glm::vec3(1.0f), tMin, hit);
+}
+
+AABB Cube::bounds() const
+{
+  return AABB(glm::vec3(0.0f), glm::vec3(1.0f));
+}
+
+//---------------------------------------------------------------------------------------
 NonhierSphere::~NonhierSphere()
 {
 }
 
+bool NonhierSphere::intersect(const Ray& ray, float tMin, Intersection& hit) const
+{
+  return intersectSphere(ray, m_pos, float(m_radius), tMin, hit);
+}
+
+AABB NonhierSphere::bounds() const
+{
+  glm::vec3 r = glm::vec3(float(m_radius));
+  return AABB(m_pos - r, m_pos + r);
+}
+
+//---------------------------------------------------------------------------------------
 NonhierBox::~NonhierBox()
 {
 }
+
+bool NonhierBox::intersect(const Ray& ray, float tMin, Intersection& hit) const
+{
+  return intersectBox(ray, m_pos, m_pos + glm::vec3(float(m_size)), tMin, hit);
+}
+
+AABB NonhierBox::bounds() const
+{
+  return AABB(m_pos, m_pos + glm::vec3(float(m_size)));
+}
@@ -2,19 +2,48 @@
 
 #include <glm/glm.hpp>
 
+#include "AABB.hpp"
+#include "Ray.hpp"
+
+// Intersection kernels shared by the primitives and the compiled scene.
+// Like Primitive::intersect, they only accept hits with t in (tMin, hit.t).
+bool intersectSphere(const Ray& ray, const glm::vec3& centre, float radius,
+  float tMin, Intersection& hit);
+// As intersectSphere, given radius * radius, for callers that have it already.
+bool intersectSphereSquared(const Ray& ray, const glm::vec3& centre, double radiusSquared,
+  float tMin, Intersection& hit);
+bool intersectBox(const Ray& ray, const glm::vec3& min, const glm::vec3& max,
+  float tMin, Intersection& hit);
+
 class Primitive {
 public:
   virtual ~Primitive();
+
+  // Intersect a ray given in the primitive's model space. Only hits with
+  // t in (tMin, hit.t) are accepted; on success hit.t and hit.normal are
+  // updated and true is returned.
+  virtual bool intersect(const Ray& ray, float tMin, Intersection& hit) const = 0;
+
+  // Bounds of the primitive in its model space.
+  virtual AABB bounds() const = 0;
 };
 
+// A unit sphere centred at the origin.
 class Sphere : public Primitive {
 public:
   virtual ~Sphere();
+
+  virtual bool intersect(const Ray& ray, float tMin, Intersection& hit) const;
+  virtual AABB bounds() const;
 };
 
+// A unit cube spanning [0, 1] on each axis.
 class Cube : public Primitive {
 public:
   virtual ~Cube();
+
+  virtual bool intersect(const Ray& ray, float tMin, Intersection& hit) const;
+  virtual AABB bounds() const;
 };
 
 class NonhierSphere : public Primitive {
@@ -25,6 +54,12 @@ public:
   }
   virtual ~NonhierSphere();
 
+  const glm::vec3& position() const { return m_pos; }
+  double radius() const { return m_radius; }
+
+  virtual bool intersect(const Ray& ray, float tMin, Intersection& hit) const;
+  virtual AABB bounds() const;
+
 private:
   glm::vec3 m_pos;
   double m_radius;
@@ -39,6 +74,12 @@ public:
   
   virtual ~NonhierBox();
 
+  const glm::vec3& position() const { return m_pos; }
+  double size() const { return m_size; }
+
+  virtual bool intersect(const Ray& ray, float tMin, Intersection& hit) const;
+  virtual AABB bounds() const;
+
 private:
   glm::vec3 m_pos;
   double m_size;
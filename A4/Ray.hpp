@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+// A ray origin + t * direction. The direction is not required to be
+// normalized, which lets rays be transformed into a primitive's model
+// space without changing the meaning of t.
+struct Ray {
+	Ray(const glm::vec3 & origin, const glm::vec3 & direction)
+		: origin(origin)
+		, direction(direction)
+		, invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z)
+	{}
+
+	glm::vec3 origin;
+	glm::vec3 direction;
+
+	// Component-wise reciprocal of direction, for slab tests.
+	glm::vec3 invDirection;
+};
+
+// The closest intersection found along a ray so far. Intersection tests
+// only accept hits closer than t, so t doubles as the search distance.
+struct Intersection {
+	Intersection(float tMax = std::numeric_limits<float>::infinity())
+		: t(tMax)
+		, normal(0.0f)
+		, material(0)
+	{}
+
+	float t;
+
+	// Surface normal in the space of the ray that was tested; not normalized.
+	glm::vec3 normal;
+
+	// Index of the surface's material in the scene being rendered.
+	uint32_t material;
+};
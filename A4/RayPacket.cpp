@@ -0,0 +1,130 @@
+#include "RayPacket.hpp"
+
+using namespace simd;
+
+//---------------------------------------------------------------------------------------
+// Solved around the point of closest approach rather than with the plain
+// quadratic formula, which loses too much precision in single precision
+// when the sphere is large or far away.
+Mask intersectSphere(const RayPacket & packet, const glm::vec3 & centre,
+	float radius, float tMin, PacketIntersection & hit)
+{
+	Float ocx = packet.ox - Float(centre.x);
+	Float ocy = packet.oy - Float(centre.y);
+	Float ocz = packet.oz - Float(centre.z);
+
+	Float a = packet.dx * packet.dx + packet.dy * packet.dy + packet.dz * packet.dz;
+	Float b = -(ocx * packet.dx + ocy * packet.dy + ocz * packet.dz) / a;
+
+	Float fx = ocx + b * packet.dx;
+	Float fy = ocy + b * packet.dy;
+	Float fz = ocz + b * packet.dz;
+	Float discriminant = Float(radius * radius) - (fx * fx + fy * fy + fz * fz);
+
+	Mask valid = packet.active & (discriminant >= Float(0.0f));
+	if (none(valid)) {
+		return valid;
+	}
+
+	Float h = sqrt(max(discriminant, Float(0.0f)) / a);
+	Float tNear = b - h;
+	Float tFar = b + h;
+	Float t = select(tNear > Float(tMin), tNear, tFar);
+
+	Mask accept = valid & (t > Float(tMin)) & (t < hit.t);
+	hit.t = select(accept, t, hit.t);
+	hit.nx = select(accept, ocx + t * packet.dx, hit.nx);
+	hit.ny = select(accept, ocy + t * packet.dy, hit.ny);
+	hit.nz = select(accept, ocz + t * packet.dz, hit.nz);
+	return accept;
+}
+
+//---------------------------------------------------------------------------------------
+Mask intersectBox(const RayPacket & packet, const glm::vec3 & min,
+	const glm::vec3 & max, float tMin, PacketIntersection & hit)
+{
+	Float x0 = (Float(min.x) - packet.ox) * packet.ix, x1 = (Float(max.x) - packet.ox) * packet.ix;
+	Float y0 = (Float(min.y) - packet.oy) * packet.iy, y1 = (Float(max.y) - packet.oy) * packet.iy;
+	Float z0 = (Float(min.z) - packet.oz) * packet.iz, z1 = (Float(max.z) - packet.oz) * packet.iz;
+
+	Float xNear = simd::min(x0, x1), xFar = simd::max(x0, x1);
+	Float yNear = simd::min(y0, y1), yFar = simd::max(y0, y1);
+	Float zNear = simd::min(z0, z1), zFar = simd::max(z0, z1);
+
+	Float tNear = simd::max(simd::max(xNear, yNear), zNear);
+	Float tFar = simd::min(simd::min(xFar, yFar), zFar);
+
+	// Entering the box, or leaving it if the ray starts inside.
+	Mask entering = tNear > Float(tMin);
+	Float t = select(entering, tNear, tFar);
+
+	Mask accept = packet.active & (tNear <= tFar) & (t > Float(tMin)) & (t < hit.t);
+	if (none(accept)) {
+		return accept;
+	}
+
+	// The face that was crossed, preferring x, then y, then z on ties as the
+	// scalar test does.
+	Mask onX = select(entering, xNear, xFar) == t;
+	Mask onY = andNot(select(entering, yNear, yFar) == t, onX);
+	Mask onZ = andNot(andNot(Mask(select(entering, zNear, zFar) == t), onX), onY);
+
+	Float zero(0.0f);
+	hit.t = select(accept, t, hit.t);
+	hit.nx = select(accept, select(onX, -signNegative(packet.dx), zero), hit.nx);
+	hit.ny = select(accept, select(onY, -signNegative(packet.dy), zero), hit.ny);
+	hit.nz = select(accept, select(onZ, -signNegative(packet.dz), zero), hit.nz);
+	return accept;
+}
+
+//---------------------------------------------------------------------------------------
+// Moller-Trumbore, one triangle against every lane.
+Mask intersectTriangle(const RayPacket & packet, const glm::vec3 & p0,
+	const glm::vec3 & p1, const glm::vec3 & p2, float tMin, PacketIntersection & hit)
+{
+	return intersectTriangleEdges(packet, p0, p1 - p0, p2 - p0, tMin, hit);
+}
+
+//---------------------------------------------------------------------------------------
+Mask intersectTriangleEdges(const RayPacket & packet, const glm::vec3 & p0,
+	const glm::vec3 & e1, const glm::vec3 & e2, float tMin, PacketIntersection & hit)
+{
+	Float e1x(e1.x), e1y(e1.y), e1z(e1.z);
+	Float e2x(e2.x), e2y(e2.y), e2z(e2.z);
+
+	Float px = packet.dy * e2z - packet.dz * e2y;
+	Float py = packet.dz * e2x - packet.dx * e2z;
+	Float pz = packet.dx * e2y - packet.dy * e2x;
+	Float det = e1x * px + e1y * py + e1z * pz;
+	Float invDet = Float(1.0f) / det;
+
+	Float sx = packet.ox - Float(p0.x);
+	Float sy = packet.oy - Float(p0.y);
+	Float sz = packet.oz - Float(p0.z);
+	Float u = (sx * px + sy * py + sz * pz) * invDet;
+
+	Mask valid = andNot(packet.active, det == Float(0.0f))
+		& (u >= Float(0.0f)) & (u <= Float(1.0f));
+	if (none(valid)) {
+		return valid;
+	}
+
+	Float qx = sy * e1z - sz * e1y;
+	Float qy = sz * e1x - sx * e1z;
+	Float qz = sx * e1y - sy * e1x;
+	Float v = (packet.dx * qx + packet.dy * qy + packet.dz * qz) * invDet;
+	Float t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+	Mask accept = valid & (v >= Float(0.0f)) & (u + v <= Float(1.0f))
+		& (t > Float(tMin)) & (t < hit.t);
+	if (none(accept)) {
+		return accept;
+	}
+
+	glm::vec3 n = glm::cross(e1, e2);
+	hit.t = select(accept, t, hit.t);
+	hit.nx = select(accept, Float(n.x), hit.nx);
+	hit.ny = select(accept, Float(n.y), hit.ny);
+	hit.nz = select(accept, Float(n.z), hit.nz);
+	return accept;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "Simd.hpp"
+
+// simd::Width rays stored as structure-of-arrays. Lanes outside the active
+// mask are carried along but never report hits.
+struct RayPacket {
+	simd::Float ox, oy, oz;
+	simd::Float dx, dy, dz;
+
+	// Component-wise reciprocal of the direction, for slab tests.
+	simd::Float ix, iy, iz;
+
+	simd::Mask active;
+
+	void computeInverse() {
+		simd::Float one(1.0f);
+		ix = one / dx;
+		iy = one / dy;
+		iz = one / dz;
+	}
+
+	// The packet with every ray transformed by the affine matrix m.
+	RayPacket transformed(const glm::mat4 & m) const {
+		RayPacket r;
+		r.ox = simd::Float(m[0][0]) * ox + simd::Float(m[1][0]) * oy + simd::Float(m[2][0]) * oz + simd::Float(m[3][0]);
+		r.oy = simd::Float(m[0][1]) * ox + simd::Float(m[1][1]) * oy + simd::Float(m[2][1]) * oz + simd::Float(m[3][1]);
+		r.oz = simd::Float(m[0][2]) * ox + simd::Float(m[1][2]) * oy + simd::Float(m[2][2]) * oz + simd::Float(m[3][2]);
+		r.dx = simd::Float(m[0][0]) * dx + simd::Float(m[1][0]) * dy + simd::Float(m[2][0]) * dz;
+		r.dy = simd::Float(m[0][1]) * dx + simd::Float(m[1][1]) * dy + simd::Float(m[2][1]) * dz;
+		r.dz = simd::Float(m[0][2]) * dx + simd::Float(m[1][2]) * dy + simd::Float(m[2][2]) * dz;
+		r.computeInverse();
+		r.active = active;
+		return r;
+	}
+
+	// Lanes whose ray passes through the box for some t in [tMin, tMax].
+	simd::Mask intersect(const AABB & box, simd::Float tMin, simd::Float tMax) const {
+		using namespace simd;
+		Float x0 = (Float(box.min.x) - ox) * ix, x1 = (Float(box.max.x) - ox) * ix;
+		Float y0 = (Float(box.min.y) - oy) * iy, y1 = (Float(box.max.y) - oy) * iy;
+		Float z0 = (Float(box.min.z) - oz) * iz, z1 = (Float(box.max.z) - oz) * iz;
+
+		// The running interval is the second operand so a NaN slab
+		// (0 * inf) leaves it unchanged.
+		Float tNear = max(min(x0, x1), tMin);
+		tNear = max(min(y0, y1), tNear);
+		tNear = max(min(z0, z1), tNear);
+		Float tFar = min(max(x0, x1), tMax);
+		tFar = min(max(y0, y1), tFar);
+		tFar = min(max(z0, z1), tFar);
+
+		return active & (tNear <= tFar);
+	}
+};
+
+// Closest hits found so far for each lane of a packet, the packet
+// counterpart of Intersection.
+struct PacketIntersection {
+	PacketIntersection()
+		: t(std::numeric_limits<float>::infinity())
+		, nx(0.0f), ny(0.0f), nz(0.0f)
+	{
+		for (int i = 0; i < simd::Width; ++i) {
+			material[i] = 0;
+		}
+	}
+
+	simd::Float t;
+
+	// Surface normal in the space of the packet that was tested; not normalized.
+	simd::Float nx, ny, nz;
+
+	uint32_t material[simd::Width];
+};
+
+// Packet intersection kernels, mirroring intersectSphere, intersectBox and
+// Mesh's triangle test. Lanes that are inactive or already have a hit
+// closer than the new one keep their old values. Return the lanes updated.
+simd::Mask intersectSphere(const RayPacket & packet, const glm::vec3 & centre,
+	float radius, float tMin, PacketIntersection & hit);
+simd::Mask intersectBox(const RayPacket & packet, const glm::vec3 & min,
+	const glm::vec3 & max, float tMin, PacketIntersection & hit);
+simd::Mask intersectTriangle(const RayPacket & packet, const glm::vec3 & p0,
+	const glm::vec3 & p1, const glm::vec3 & p2, float tMin, PacketIntersection & hit);
+// As intersectTriangle, given the edges e1 = p1 - p0 and e2 = p2 - p0.
+simd::Mask intersectTriangleEdges(const RayPacket & packet, const glm::vec3 & p0,
+	const glm::vec3 & e1, const glm::vec3 & e2, float tMin, PacketIntersection & hit);
@@ -0,0 +1,22 @@
+#include "RenderSettings.hpp"
+
+//---------------------------------------------------------------------------------------
+RenderSettings::RenderSettings()
+	: threads(0),
+	  tileSize(0),
+	  packetTracing(false),
+	  samplesPerPixel(1),
+	  supersamplingDepth(0),
+	  supersamplingThreshold(DefaultSupersamplingThreshold),
+	  maxDepth(8),
+	  rayBudget(64),
+	  rouletteDepth(3),
+	  checkpointInterval(0.0),
+	  imageFormat(Image::Format::Float),
+	  streamingOutput(false),
+	  width(0),
+	  height(0),
+	  acceleration(Acceleration::Bvh),
+	  meshLayout(TriangleLayout::Precomputed)
+{
+}
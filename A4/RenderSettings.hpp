@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+
+#include "CompiledScene.hpp"
+#include "Image.hpp"
+
+const float DefaultSupersamplingThreshold = 0.1f;
+
+// Everything about how a frame is rendered that is not part of the scene:
+// the knobs that trade quality for speed and those that pick how the work
+// is done. Main.cpp sets the defaults from the command line (see
+// A4_SetDefaultSettings) and gr.render's options table overrides them for
+// one render.
+struct RenderSettings {
+	RenderSettings();
+
+	// Render threads. 0 means one per hardware thread; 1 renders on the
+	// calling thread without a pool.
+	unsigned int threads;
+
+	// Edge of the square tiles handed to threads. 0 means
+	// TileScheduler::DefaultTileSize.
+	unsigned int tileSize;
+
+	// Trace primary rays in SIMD packets instead of one at a time.
+	bool packetTracing;
+
+	// Rays per pixel, through the centres of a regular grid of subpixels;
+	// rounded down to a square (1, 4, 9, ...).
+	unsigned int samplesPerPixel;
+
+	// After the first samples of each pixel, supersample pixels whose
+	// colour differs from a neighbour's by more than supersamplingThreshold
+	// in any channel, splitting each into 2x2 subpixels and those that
+	// still stand out again, up to supersamplingDepth levels (at most
+	// 4^depth rays per pixel). 0 turns adaptive supersampling off.
+	unsigned int supersamplingDepth;
+	float supersamplingThreshold;
+
+	// Reflected and refracted rays, off mirror and glass materials, are
+	// followed for at most maxDepth bounces from the primary ray, and at
+	// most rayBudget of them are traced for each pixel: for all its samples
+	// together in the first pass, and again if supersampling refines it. Past
+	// rouletteDepth bounces, Russian roulette ends rays at random in
+	// proportion to how little they could add. maxDepth 0 turns secondary
+	// rays off.
+	unsigned int maxDepth;
+	unsigned int rayBudget;
+	unsigned int rouletteDepth;
+
+	// Render in progressive passes, coarse to fine, saving the image so far
+	// to the output file every checkpointInterval seconds from a background
+	// thread along with <output>.resume, which a later render of the same
+	// file picks up from. 0 renders in one pass and saves at the end.
+	double checkpointInterval;
+
+	// Storage for the framebuffer: Float or Half, which halves its size.
+	Image::Format imageFormat;
+
+	// Encode and write tiles as they finish instead of keeping a
+	// framebuffer, so memory use does not grow with the image size. Not
+	// available with progressive rendering or supersampling, which need the
+	// whole image.
+	bool streamingOutput;
+
+	// If both are set, render at this size whatever size the script asks
+	// for, e.g. to benchmark scenes at a fixed size.
+	unsigned int width;
+	unsigned int height;
+
+	// What CompiledScene builds over the scene's instances.
+	Acceleration acceleration;
+
+	// How meshes store their triangles. Meshes are loaded as the script
+	// runs, before gr.render, so only the default from the command line
+	// applies.
+	TriangleLayout meshLayout;
+};
@@ -0,0 +1,174 @@
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+//---------------------------------------------------------------------------------------
+TraceStats::TraceStats()
+	: primaryRays(0),
+	  secondaryRays(0),
+	  shadowRays(0),
+	  shadowOccluded(0),
+	  shadowCacheHits(0),
+	  nodeVisits(0),
+	  primitiveTests(0),
+	  hits(0),
+	  traversalSeconds(0.0),
+	  shadingSeconds(0.0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+void TraceStats::merge(const TraceStats & other)
+{
+	primaryRays += other.primaryRays;
+	secondaryRays += other.secondaryRays;
+	shadowRays += other.shadowRays;
+	shadowOccluded += other.shadowOccluded;
+	shadowCacheHits += other.shadowCacheHits;
+	nodeVisits += other.nodeVisits;
+	primitiveTests += other.primitiveTests;
+	hits += other.hits;
+	traversalSeconds += other.traversalSeconds;
+	shadingSeconds += other.shadingSeconds;
+}
+
+//---------------------------------------------------------------------------------------
+Stopwatch::Stopwatch(bool running)
+{
+	if (running) {
+		m_start = std::chrono::steady_clock::now();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+double Stopwatch::seconds() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+//---------------------------------------------------------------------------------------
+double Stopwatch::lap()
+{
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - m_start).count();
+	m_start = now;
+	return elapsed;
+}
+
+//---------------------------------------------------------------------------------------
+double Stopwatch::overhead()
+{
+	static const double measured = [] {
+		Stopwatch clock;
+		double shortest = clock.lap();
+		for (int i = 0; i < 1000; ++i) {
+			shortest = std::min(shortest, clock.lap());
+		}
+		return shortest;
+	}();
+	return measured;
+}
+
+//---------------------------------------------------------------------------------------
+RenderStats::RenderStats()
+	: width(0),
+	  height(0),
+	  threads(0),
+	  processes(0),
+	  sceneBytes(0),
+	  sceneReservedBytes(0)
+{
+}
+
+//---------------------------------------------------------------------------------------
+void RenderStats::addPhase(const std::string & phase, double seconds)
+{
+	for (auto & existing : phases) {
+		if (existing.first == phase) {
+			existing.second += seconds;
+			return;
+		}
+	}
+	phases.emplace_back(phase, seconds);
+}
+
+//---------------------------------------------------------------------------------------
+static std::string jsonString(const std::string & s)
+{
+	std::ostringstream out;
+	out << '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out << '\\' << c;
+		} else if ((unsigned char)c < 0x20) {
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+		} else {
+			out << c;
+		}
+	}
+	out << '"';
+	return out.str();
+}
+
+//---------------------------------------------------------------------------------------
+void RenderStats::writeJson(std::ostream & out) const
+{
+	double renderSeconds = 0.0;
+	double totalSeconds = 0.0;
+	for (const auto & phase : phases) {
+		totalSeconds += phase.second;
+		if (phase.first == "render") {
+			renderSeconds = phase.second;
+		}
+	}
+	uint64_t rays = trace.primaryRays + trace.secondaryRays + trace.shadowRays;
+
+	out << "{\n"
+		<< "  \"output\": " << jsonString(output) << ",\n"
+		<< "  \"width\": " << width << ",\n"
+		<< "  \"height\": " << height << ",\n"
+		<< "  \"threads\": " << threads << ",\n"
+		<< "  \"processes\": " << processes << ",\n"
+		<< "  \"scene_memory\": {\n"
+		<< "    \"used\": " << sceneBytes << ",\n"
+		<< "    \"reserved\": " << sceneReservedBytes << "\n"
+		<< "  },\n"
+		<< "  \"rays\": {\n"
+		<< "    \"primary\": " << trace.primaryRays << ",\n"
+		<< "    \"secondary\": " << trace.secondaryRays << ",\n"
+		<< "    \"shadow\": " << trace.shadowRays << ",\n"
+		<< "    \"shadow_occluded\": " << trace.shadowOccluded << ",\n"
+		<< "    \"shadow_cache_hits\": " << trace.shadowCacheHits << ",\n"
+		<< "    \"hits\": " << trace.hits << ",\n"
+		<< "    \"per_second\": " << (renderSeconds > 0.0 ? rays / renderSeconds : 0.0) << "\n"
+		<< "  },\n"
+		<< "  \"node_visits\": " << trace.nodeVisits << ",\n"
+		<< "  \"primitive_tests\": " << trace.primitiveTests << ",\n"
+		<< "  \"worker_seconds\": {\n"
+		<< "    \"traversal\": " << trace.traversalSeconds << ",\n"
+		<< "    \"shading\": " << trace.shadingSeconds << "\n"
+		<< "  },\n"
+		<< "  \"phase_seconds\": {\n";
+	for (const auto & phase : phases) {
+		out << "    " << jsonString(phase.first) << ": " << phase.second << ",\n";
+	}
+	out << "    \"total\": " << totalSeconds << "\n"
+		<< "  }\n"
+		<< "}\n";
+}
+
+//---------------------------------------------------------------------------------------
+bool RenderStats::saveJson(const std::string & filename) const
+{
+	std::ofstream file(filename.c_str());
+	if (!file) {
+		std::cerr << "Could not create " << filename << std::endl;
+		return false;
+	}
+	writeJson(file);
+	return bool(file);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counts of the work done tracing rays. Every render worker counts into its
+// own copy, with no atomics or locks on the hot path, and the copies are
+// merged once the frame is done.
+struct TraceStats {
+	TraceStats();
+
+	// Adds other's counts to this one's.
+	void merge(const TraceStats & other);
+
+	uint64_t primaryRays;
+	// Rays spawned at a hit other than shadow rays (reflection, refraction).
+	uint64_t secondaryRays;
+	uint64_t shadowRays;
+	// Shadow rays that were blocked, and those of them that the worker's
+	// last-occluder cache settled without a traversal.
+	uint64_t shadowOccluded;
+	uint64_t shadowCacheHits;
+
+	// BVH nodes whose bounds were tested, in the scene and mesh BVHs alike.
+	uint64_t nodeVisits;
+	// Ray/instance and ray/triangle tests.
+	uint64_t primitiveTests;
+	// Primary and secondary rays that hit something.
+	uint64_t hits;
+
+	// Time spent finding the hits of primary rays and shading them (which
+	// includes their shadow rays), summed over workers. Estimated from a
+	// sample of the rays, so only roughly comparable with wall clock time.
+	double traversalSeconds;
+	double shadingSeconds;
+};
+
+// Wall clock time since construction or the last lap().
+class Stopwatch {
+public:
+	// With running false the clock is not read until the first lap(), for
+	// code that only sometimes wants a time.
+	explicit Stopwatch(bool running = true);
+
+	double seconds() const;
+
+	// Returns seconds() and starts again from now.
+	double lap();
+
+	// What reading the clock adds to a time, measured once. Worth taking
+	// off times of very short stretches.
+	static double overhead();
+
+private:
+	std::chrono::steady_clock::time_point m_start;
+};
+
+// Everything measured while handling one gr.render call.
+struct RenderStats {
+	RenderStats();
+
+	// Add seconds of wall clock time to phase, e.g. "render". Phases are
+	// reported in the order they were first added.
+	void addPhase(const std::string & phase, double seconds);
+
+	void writeJson(std::ostream & out) const;
+	bool saveJson(const std::string & filename) const;
+
+	std::string output;
+	uint32_t width;
+	uint32_t height;
+	unsigned int threads;
+	// Worker processes that traced tiles, 0 if the frame was rendered here.
+	unsigned int processes;
+
+	// The script's scene graph (nodes, primitives, materials and lights, but
+	// not what meshes allocate themselves): bytes of objects, and bytes of
+	// the arena blocks holding them.
+	uint64_t sceneBytes;
+	uint64_t sceneReservedBytes;
+
+	TraceStats trace;
+	std::vector<std::pair<std::string, double>> phases;
+};
@@ -2,6 +2,7 @@
 
 #include "cs488-framework/MathUtils.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 using namespace std;
@@ -28,24 +29,9 @@ SceneNode::SceneNode(const std::string& name)
 
 }
 
-//---------------------------------------------------------------------------------------
-// Deep copy
-SceneNode::SceneNode(const SceneNode & other)
-	: m_nodeType(other.m_nodeType),
-	  m_name(other.m_name),
-	  trans(other.trans),
-	  invtrans(other.invtrans)
-{
-	for(SceneNode * child : other.children) {
-		this->children.push_front(new SceneNode(*child));
-	}
-}
-
 //---------------------------------------------------------------------------------------
 SceneNode::~SceneNode() {
-	for(SceneNode * child : children) {
-		delete child;
-	}
+
 }
 
 //---------------------------------------------------------------------------------------
@@ -71,7 +57,7 @@ void SceneNode::add_child(SceneNode* child) {
 
 //---------------------------------------------------------------------------------------
 void SceneNode::remove_child(SceneNode* child) {
-	children.remove(child);
+	children.erase(std::remove(children.begin(), children.end(), child), children.end());
 }
 
 //---------------------------------------------------------------------------------------
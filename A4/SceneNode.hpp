@@ -4,9 +4,9 @@
 
 #include <glm/glm.hpp>
 
-#include <list>
 #include <string>
 #include <iostream>
+#include <vector>
 
 enum class NodeType {
 	SceneNode,
@@ -14,11 +14,13 @@ enum class NodeType {
 	JointNode
 };
 
+// A node of the scene graph. Nodes do not own their children: the scene
+// script makes every node in an Arena, which frees them all together.
 class SceneNode {
 public:
     SceneNode(const std::string & name);
 
-	SceneNode(const SceneNode & other);
+	SceneNode(const SceneNode & other) = delete;
 
     virtual ~SceneNode();
     
@@ -45,7 +47,9 @@ public:
     glm::mat4 trans;
     glm::mat4 invtrans;
     
-    std::list<SceneNode*> children;
+    // In the order they were added, contiguous so that walking the graph
+    // (e.g. to compile it) does not chase list links.
+    std::vector<SceneNode*> children;
 
 	NodeType m_nodeType;
 	std::string m_name;
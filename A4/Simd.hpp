@@ -0,0 +1,211 @@
+#pragma once
+
+// A minimal wrapper over the widest float vector the compiler targets:
+// 8 lanes with AVX (-mavx), 4 with SSE2 (always on x86-64), otherwise a
+// plain 4-lane array so the packet code still builds everywhere. Define
+// A4_NO_SIMD to force the plain version.
+
+#include <cmath>
+#include <cstdint>
+
+#if !defined(A4_NO_SIMD) && defined(__AVX__)
+#  include <immintrin.h>
+#  define A4_SIMD_AVX
+#elif !defined(A4_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#  include <emmintrin.h>
+#  define A4_SIMD_SSE
+#endif
+
+namespace simd {
+
+#if defined(A4_SIMD_AVX)
+
+const int Width = 8;
+const char * const Name = "AVX";
+
+struct Mask {
+	Mask() {}
+	Mask(__m256 v) : v(v) {}
+	__m256 v;
+};
+
+struct Float {
+	Float() {}
+	Float(__m256 v) : v(v) {}
+	explicit Float(float x) : v(_mm256_set1_ps(x)) {}
+
+	static Float load(const float * p) { return _mm256_loadu_ps(p); }
+	void store(float * p) const { _mm256_storeu_ps(p, v); }
+
+	// 0, 1, 2, ... Width - 1.
+	static Float lanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+	__m256 v;
+};
+
+inline Float operator + (Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+inline Float operator - (Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float operator * (Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float operator / (Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+inline Float operator - (Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+inline Mask operator < (Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline Mask operator <= (Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline Mask operator > (Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Mask operator >= (Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline Mask operator == (Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+
+inline Mask operator & (Mask a, Mask b) { return _mm256_and_ps(a.v, b.v); }
+inline Mask operator | (Mask a, Mask b) { return _mm256_or_ps(a.v, b.v); }
+inline Mask operator ^ (Mask a, Mask b) { return _mm256_xor_ps(a.v, b.v); }
+// a and not b.
+inline Mask andNot(Mask a, Mask b) { return _mm256_andnot_ps(b.v, a.v); }
+
+// Lane-wise m ? a : b.
+inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+// One bit per lane, lane 0 in the lowest bit.
+inline int bits(Mask m) { return _mm256_movemask_ps(m.v); }
+
+#elif defined(A4_SIMD_SSE)
+
+const int Width = 4;
+const char * const Name = "SSE2";
+
+struct Mask {
+	Mask() {}
+	Mask(__m128 v) : v(v) {}
+	__m128 v;
+};
+
+struct Float {
+	Float() {}
+	Float(__m128 v) : v(v) {}
+	explicit Float(float x) : v(_mm_set1_ps(x)) {}
+
+	static Float load(const float * p) { return _mm_loadu_ps(p); }
+	void store(float * p) const { _mm_storeu_ps(p, v); }
+
+	// 0, 1, 2, ... Width - 1.
+	static Float lanes() { return _mm_setr_ps(0, 1, 2, 3); }
+
+	__m128 v;
+};
+
+inline Float operator + (Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+inline Float operator - (Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+inline Float operator * (Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+inline Float operator / (Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+inline Float operator - (Float a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+inline Mask operator < (Float a, Float b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Mask operator <= (Float a, Float b) { return _mm_cmple_ps(a.v, b.v); }
+inline Mask operator > (Float a, Float b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline Mask operator >= (Float a, Float b) { return _mm_cmpge_ps(a.v, b.v); }
+inline Mask operator == (Float a, Float b) { return _mm_cmpeq_ps(a.v, b.v); }
+
+inline Mask operator & (Mask a, Mask b) { return _mm_and_ps(a.v, b.v); }
+inline Mask operator | (Mask a, Mask b) { return _mm_or_ps(a.v, b.v); }
+inline Mask operator ^ (Mask a, Mask b) { return _mm_xor_ps(a.v, b.v); }
+// a and not b.
+inline Mask andNot(Mask a, Mask b) { return _mm_andnot_ps(b.v, a.v); }
+
+// Lane-wise m ? a : b.
+inline Float select(Mask m, Float a, Float b) {
+	return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v));
+}
+
+// One bit per lane, lane 0 in the lowest bit.
+inline int bits(Mask m) { return _mm_movemask_ps(m.v); }
+
+#else
+
+const int Width = 4;
+const char * const Name = "scalar";
+
+struct Mask {
+	bool v[4];
+};
+
+struct Float {
+	Float() {}
+	explicit Float(float x) { for (int i = 0; i < 4; ++i) v[i] = x; }
+
+	static Float load(const float * p) { Float r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+	void store(float * p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+
+	// 0, 1, 2, ... Width - 1.
+	static Float lanes() { Float r; for (int i = 0; i < 4; ++i) r.v[i] = float(i); return r; }
+
+	float v[4];
+};
+
+#define A4_SIMD_LANEWISE(result, expr) \
+	result r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r
+
+inline Float operator + (Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] + b.v[i]); }
+inline Float operator - (Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] - b.v[i]); }
+inline Float operator * (Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] * b.v[i]); }
+inline Float operator / (Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] / b.v[i]); }
+inline Float operator - (Float a) { A4_SIMD_LANEWISE(Float, -a.v[i]); }
+// Operand order matches minps/maxps: the second operand wins on NaN.
+inline Float min(Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+inline Float max(Float a, Float b) { A4_SIMD_LANEWISE(Float, a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+inline Float sqrt(Float a) { A4_SIMD_LANEWISE(Float, std::sqrt(a.v[i])); }
+inline Float abs(Float a) { A4_SIMD_LANEWISE(Float, std::fabs(a.v[i])); }
+
+inline Mask operator < (Float a, Float b) { A4_SIMD_LANEWISE(Mask, a.v[i] < b.v[i]); }
+inline Mask operator <= (Float a, Float b) { A4_SIMD_LANEWISE(Mask, a.v[i] <= b.v[i]); }
+inline Mask operator > (Float a, Float b) { A4_SIMD_LANEWISE(Mask, a.v[i] > b.v[i]); }
+inline Mask operator >= (Float a, Float b) { A4_SIMD_LANEWISE(Mask, a.v[i] >= b.v[i]); }
+inline Mask operator == (Float a, Float b) { A4_SIMD_LANEWISE(Mask, a.v[i] == b.v[i]); }
+
+inline Mask operator & (Mask a, Mask b) { A4_SIMD_LANEWISE(Mask, a.v[i] && b.v[i]); }
+inline Mask operator | (Mask a, Mask b) { A4_SIMD_LANEWISE(Mask, a.v[i] || b.v[i]); }
+inline Mask operator ^ (Mask a, Mask b) { A4_SIMD_LANEWISE(Mask, a.v[i] != b.v[i]); }
+// a and not b.
+inline Mask andNot(Mask a, Mask b) { A4_SIMD_LANEWISE(Mask, a.v[i] && !b.v[i]); }
+
+// Lane-wise m ? a : b.
+inline Float select(Mask m, Float a, Float b) { A4_SIMD_LANEWISE(Float, m.v[i] ? a.v[i] : b.v[i]); }
+
+#undef A4_SIMD_LANEWISE
+
+// One bit per lane, lane 0 in the lowest bit.
+inline int bits(Mask m) {
+	int r = 0;
+	for (int i = 0; i < 4; ++i) r |= m.v[i] ? (1 << i) : 0;
+	return r;
+}
+
+#endif
+
+inline bool any(Mask m) { return bits(m) != 0; }
+inline bool none(Mask m) { return bits(m) == 0; }
+inline bool all(Mask m) { return bits(m) == (1 << Width) - 1; }
+
+// Apply a scalar function to every lane, for the few operations (acos,
+// cbrt, ...) that have no vector instruction.
+inline Float apply(Float x, float (*f)(float)) {
+	float lanes[Width];
+	x.store(lanes);
+	for (int i = 0; i < Width; ++i) {
+		lanes[i] = f(lanes[i]);
+	}
+	return Float::load(lanes);
+}
+
+// Lane-wise x < 0 ? -1 : 1.
+inline Float signNegative(Float x) {
+	return select(x < Float(0.0f), Float(-1.0f), Float(1.0f));
+}
+
+} // namespace simd
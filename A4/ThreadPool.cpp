@@ -0,0 +1,130 @@
+#include "ThreadPool.hpp"
+
+//---------------------------------------------------------------------------------------
+ThreadPool::ThreadPool(unsigned int threadCount)
+	: m_task(nullptr),
+	  m_remaining(0),
+	  m_generation(0),
+	  m_stop(false)
+{
+	if (threadCount == 0) {
+		threadCount = hardwareThreads();
+	}
+
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		m_queues.emplace_back(new WorkQueue());
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread & thread : m_threads) {
+		thread.join();
+	}
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int ThreadPool::size() const
+{
+	return (unsigned int)m_threads.size();
+}
+
+//---------------------------------------------------------------------------------------
+unsigned int ThreadPool::hardwareThreads()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+//---------------------------------------------------------------------------------------
+void ThreadPool::parallelFor(size_t count, const Task & task)
+{
+	if (count == 0) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_task = &task;
+	m_remaining = count;
+
+	// Deal the items out round-robin so neighbouring items, which tend to
+	// cost about the same, start out on different threads.
+	size_t queueCount = m_queues.size();
+	for (size_t q = 0; q < queueCount; ++q) {
+		std::lock_guard<std::mutex> queueLock(m_queues[q]->mutex);
+		for (size_t item = q; item < count; item += queueCount) {
+			m_queues[q]->items.push_back(item);
+		}
+	}
+
+	++m_generation;
+	m_wake.notify_all();
+
+	m_done.wait(lock, [this] { return m_remaining == 0; });
+	m_task = nullptr;
+}
+
+//---------------------------------------------------------------------------------------
+// Pop from the back of our own queue, otherwise steal from the front of
+// someone else's. The task is read under the queue lock so that it always
+// matches the generation the item was queued with.
+bool ThreadPool::nextItem(unsigned int worker, size_t & item, const Task *& task)
+{
+	size_t queueCount = m_queues.size();
+	for (size_t i = 0; i < queueCount; ++i) {
+		WorkQueue & queue = *m_queues[(worker + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.items.empty()) {
+			continue;
+		}
+
+		if (i == 0) {
+			item = queue.items.back();
+			queue.items.pop_back();
+		} else {
+			item = queue.items.front();
+			queue.items.pop_front();
+		}
+		task = m_task;
+		return true;
+	}
+	return false;
+}
+
+//---------------------------------------------------------------------------------------
+void ThreadPool::workerLoop(unsigned int worker)
+{
+	size_t seenGeneration = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+			if (m_stop) {
+				return;
+			}
+			seenGeneration = m_generation;
+		}
+
+		size_t item;
+		const Task * task;
+		while (nextItem(worker, item, task)) {
+			(*task)(worker, item);
+
+			if (--m_remaining == 0) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_done.notify_all();
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size pool of worker threads with one work queue per worker.
+ *
+ * Work is handed out with parallelFor(). Each worker drains its own queue
+ * from the back and, once that is empty, steals from the front of the other
+ * workers' queues, so uneven items (e.g. tiles covering a complex part of
+ * the scene) do not leave threads idle at the end of a frame.
+ *
+ * The threads stay alive between calls so the pool can be reused.
+ */
+class ThreadPool {
+public:
+	// Called with the index of the worker running it, in [0, size()),
+	// and the index of the work item.
+	typedef std::function<void(unsigned int worker, size_t item)> Task;
+
+	// Create a pool with the given number of threads. A count of 0 means
+	// one thread per hardware thread.
+	explicit ThreadPool(unsigned int threadCount = 0);
+
+	~ThreadPool();
+
+	// Returns the number of worker threads.
+	unsigned int size() const;
+
+	// Run task for every item in [0, count), blocking until all are done.
+	void parallelFor(size_t count, const Task & task);
+
+	// Returns the number of hardware threads, or 1 if it cannot be determined.
+	static unsigned int hardwareThreads();
+
+private:
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<size_t> items;
+	};
+
+	void workerLoop(unsigned int worker);
+	bool nextItem(unsigned int worker, size_t & item, const Task *& task);
+
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	const Task * m_task;
+	std::atomic<size_t> m_remaining;
+	size_t m_generation;
+	bool m_stop;
+};
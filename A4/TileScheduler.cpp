@@ -0,0 +1,38 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+
+const uint TileScheduler::DefaultTileSize = 16;
+
+//---------------------------------------------------------------------------------------
+TileScheduler::TileScheduler(uint width, uint height, uint tileSize)
+{
+	if (tileSize == 0) {
+		tileSize = DefaultTileSize;
+	}
+
+	for (uint y = 0; y < height; y += tileSize) {
+		for (uint x = 0; x < width; x += tileSize) {
+			Tile tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = std::min(x + tileSize, width);
+			tile.y1 = std::min(y + tileSize, height);
+			m_tiles.push_back(tile);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+const std::vector<Tile> & TileScheduler::tiles() const
+{
+	return m_tiles;
+}
+
+//---------------------------------------------------------------------------------------
+void TileScheduler::run(ThreadPool & pool, const TileTask & task) const
+{
+	pool.parallelFor(m_tiles.size(), [&](unsigned int worker, size_t item) {
+		task(worker, m_tiles[item]);
+	});
+}
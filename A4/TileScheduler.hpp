@@ -0,0 +1,37 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+// A rectangle of pixels, [x0, x1) x [y0, y1).
+struct Tile {
+	uint x0, y0;
+	uint x1, y1;
+};
+
+/**
+ * Splits an image into square tiles and renders them on a ThreadPool.
+ *
+ * Every pixel belongs to exactly one tile and is rendered exactly once, so
+ * as long as the per-pixel work only depends on the pixel coordinates the
+ * result is identical to rendering the whole image on one thread.
+ */
+class TileScheduler {
+public:
+	typedef std::function<void(unsigned int worker, const Tile & tile)> TileTask;
+
+	TileScheduler(uint width, uint height, uint tileSize);
+
+	const std::vector<Tile> & tiles() const;
+
+	// Render every tile on the pool, blocking until the image is complete.
+	void run(ThreadPool & pool, const TileTask & task) const;
+
+	static const uint DefaultTileSize;
+
+private:
+	std::vector<Tile> m_tiles;
+};
@@ -0,0 +1,187 @@
+// Compares the two ways CompiledScene can test the spheres and box of
+// Assets/nonhier.lua: through the generic path every transformed instance
+// takes (ray into model space by worldToModel, the sphere's quadratic
+// through quadraticRoots, normal back by normalToWorld), and through the
+// world space kernels WorldSphere and WorldBox instances use. Every
+// primary ray of a square render of the scene is tested against all six
+// primitives both ways; the hits must agree exactly.
+//
+//     NonhierBench [size] [runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../Primitive.hpp"
+#include "../polyroots.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct Shape {
+	bool sphere;
+	glm::vec3 position;
+	float size;
+};
+
+// As placed by Assets/nonhier.lua, all directly under the root.
+static const Shape Shapes[] = {
+	{ true, glm::vec3(0, 0, -400), 100 },
+	{ true, glm::vec3(200, 50, -100), 150 },
+	{ true, glm::vec3(0, -1200, -500), 1000 },
+	{ false, glm::vec3(-200, -125, 0), 100 },
+	{ true, glm::vec3(-100, 25, -300), 50 },
+	{ true, glm::vec3(0, 100, -250), 25 }
+};
+
+static const size_t ShapeCount = sizeof(Shapes) / sizeof(Shapes[0]);
+
+//---------------------------------------------------------------------------------------
+static double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+// intersectSphere as it was before it solved the quadratic itself.
+static bool intersectSphereRoots(const Ray & ray, const glm::vec3 & centre, float radius,
+	float tMin, Intersection & hit)
+{
+	glm::vec3 oc = ray.origin - centre;
+	double A = glm::dot(ray.direction, ray.direction);
+	double B = 2.0 * glm::dot(ray.direction, oc);
+	double C = glm::dot(oc, oc) - double(radius) * radius;
+
+	double roots[2];
+	size_t count = quadraticRoots(A, B, C, roots);
+
+	bool found = false;
+	for (size_t i = 0; i < count; ++i) {
+		float t = float(roots[i]);
+		if (t > tMin && t < hit.t) {
+			hit.t = t;
+			found = true;
+		}
+	}
+
+	if (found) {
+		hit.normal = ray.origin + hit.t * ray.direction - centre;
+	}
+	return found;
+}
+
+//---------------------------------------------------------------------------------------
+// The camera of nonhier.lua: eye at (0, 0, 800) looking down -z, 50 degrees.
+static vector<Ray> primaryRays(int size)
+{
+	vector<Ray> rays;
+	rays.reserve(size_t(size) * size);
+	float half = std::tan(glm::radians(50.0f) / 2.0f);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			float u = (2.0f * (x + 0.5f) / size - 1.0f) * half;
+			float v = (1.0f - 2.0f * (y + 0.5f) / size) * half;
+			rays.push_back(Ray(glm::vec3(0.0f, 0.0f, 800.0f), glm::vec3(u, v, -1.0f)));
+		}
+	}
+	return rays;
+}
+
+//---------------------------------------------------------------------------------------
+static void generic(const vector<Ray> & rays, const glm::mat4 & worldToModel,
+	vector<Intersection> & hits)
+{
+	glm::mat3 normalToWorld = glm::transpose(glm::mat3(worldToModel));
+	for (size_t i = 0; i < rays.size(); ++i) {
+		Intersection hit;
+		for (const Shape & shape : Shapes) {
+			Ray local(glm::vec3(worldToModel * glm::vec4(rays[i].origin, 1.0f)),
+			          glm::vec3(worldToModel * glm::vec4(rays[i].direction, 0.0f)));
+			bool found = shape.sphere
+				? intersectSphereRoots(local, shape.position, shape.size, 0.0f, hit)
+				: intersectBox(local, shape.position, shape.position + glm::vec3(shape.size),
+					0.0f, hit);
+			if (found) {
+				hit.normal = normalToWorld * hit.normal;
+			}
+		}
+		hits[i] = hit;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+static void world(const vector<Ray> & rays, const double * radiusSquared,
+	vector<Intersection> & hits)
+{
+	for (size_t i = 0; i < rays.size(); ++i) {
+		Intersection hit;
+		for (size_t s = 0; s < ShapeCount; ++s) {
+			const Shape & shape = Shapes[s];
+			if (shape.sphere) {
+				intersectSphereSquared(rays[i], shape.position, radiusSquared[s], 0.0f, hit);
+			} else {
+				intersectBox(rays[i], shape.position, shape.position + glm::vec3(shape.size),
+					0.0f, hit);
+			}
+		}
+		hits[i] = hit;
+	}
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+	int size = argc > 1 ? atoi(argv[1]) : 512;
+	int runs = argc > 2 ? atoi(argv[2]) : 5;
+	if (size <= 0 || runs <= 0) {
+		fprintf(stderr, "usage: NonhierBench [size] [runs]\n");
+		return 1;
+	}
+
+	vector<Ray> rays = primaryRays(size);
+	vector<Intersection> genericHits(rays.size()), worldHits(rays.size());
+
+	// Read at run time, so the compiler cannot see that it is the identity.
+	glm::mat4 worldToModel(float(argc > 0));
+
+	double radiusSquared[ShapeCount];
+	for (size_t s = 0; s < ShapeCount; ++s) {
+		radiusSquared[s] = double(Shapes[s].size) * Shapes[s].size;
+	}
+
+	vector<double> genericSeconds, worldSeconds;
+	for (int run = 0; run < runs; ++run) {
+		Clock::time_point start = Clock::now();
+		generic(rays, worldToModel, genericHits);
+		genericSeconds.push_back(secondsSince(start));
+
+		start = Clock::now();
+		world(rays, radiusSquared, worldHits);
+		worldSeconds.push_back(secondsSince(start));
+	}
+	sort(genericSeconds.begin(), genericSeconds.end());
+	sort(worldSeconds.begin(), worldSeconds.end());
+	double genericMedian = genericSeconds[runs / 2];
+	double worldMedian = worldSeconds[runs / 2];
+
+	size_t hits = 0, mismatches = 0;
+	for (size_t i = 0; i < rays.size(); ++i) {
+		hits += genericHits[i].t < INFINITY;
+		if (genericHits[i].t != worldHits[i].t || genericHits[i].normal != worldHits[i].normal) {
+			++mismatches;
+		}
+	}
+
+	printf("%d x %d rays against %zu primitives, %zu hits, median of %d runs\n",
+		size, size, ShapeCount, hits, runs);
+	printf("generic %7.2f ns/ray  world space %7.2f ns/ray  speedup %5.2fx  mismatches %zu\n",
+		1e9 * genericMedian / rays.size(), 1e9 * worldMedian / rays.size(),
+		genericMedian / worldMedian, mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
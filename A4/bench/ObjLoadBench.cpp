@@ -0,0 +1,121 @@
+// Compares loadObj (ObjParser.hpp) with the iostream loop Mesh::Mesh used
+// to read .obj files with: time per load, and whether both give exactly
+// the same vertices and triangles. Files the old loop cannot read (faces
+// with slashes or more than three vertices) are only timed.
+//
+//     ObjLoadBench [runs] [file.obj ...]
+//
+// Run it from the A4 directory; by default it loads Assets/cow.obj and
+// Assets/mickey.obj.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../ObjParser.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//---------------------------------------------------------------------------------------
+static double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+// The loop Mesh::Mesh used before ObjParser.
+static bool loadWithIostream(const string & filename, ObjMesh & mesh)
+{
+	string code;
+	double vx, vy, vz;
+	size_t s1, s2, s3;
+
+	ifstream ifs(filename.c_str());
+	if (!ifs) {
+		return false;
+	}
+	while (ifs >> code) {
+		if (code == "v") {
+			ifs >> vx >> vy >> vz;
+			mesh.vertices.push_back(glm::vec3(vx, vy, vz));
+		} else if (code == "f") {
+			ifs >> s1 >> s2 >> s3;
+			mesh.triangles.push_back(uint32_t(s1 - 1));
+			mesh.triangles.push_back(uint32_t(s2 - 1));
+			mesh.triangles.push_back(uint32_t(s3 - 1));
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+static bool sameMesh(const ObjMesh & a, const ObjMesh & b)
+{
+	return a.vertices.size() == b.vertices.size()
+		&& memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(glm::vec3)) == 0
+		&& a.triangles == b.triangles;
+}
+
+//---------------------------------------------------------------------------------------
+// Fastest of runs loads, which is the least disturbed by everything else.
+template <typename Load>
+static double fastest(int runs, Load load)
+{
+	double best = 1e30;
+	for (int run = 0; run < runs; ++run) {
+		Clock::time_point start = Clock::now();
+		load();
+		best = min(best, secondsSince(start));
+	}
+	return best;
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+	int runs = argc > 1 ? max(1, atoi(argv[1])) : 50;
+	vector<string> files(argv + min(argc, 2), argv + argc);
+	if (files.empty()) {
+		files = { "Assets/cow.obj", "Assets/mickey.obj" };
+	}
+
+	printf("%-20s %10s %10s %12s %8s  %s\n",
+		"file", "vertices", "triangles", "iostream ms", "new ms", "speedup");
+
+	bool ok = true;
+	for (const string & filename : files) {
+		ObjMesh parsed;
+		string error;
+		if (!loadObj(filename, parsed, error)) {
+			printf("%s\n", error.c_str());
+			ok = false;
+			continue;
+		}
+
+		ObjMesh old;
+		loadWithIostream(filename, old);
+		bool comparable = sameMesh(parsed, old);
+
+		double oldSeconds = fastest(runs, [&]() {
+			ObjMesh mesh;
+			loadWithIostream(filename, mesh);
+		});
+		double newSeconds = fastest(runs, [&]() {
+			ObjMesh mesh;
+			loadObj(filename, mesh, error);
+		});
+
+		printf("%-20s %10zu %10zu %12.3f %8.3f  %6.2fx%s\n", filename.c_str(),
+			parsed.vertices.size(), parsed.triangles.size() / 3,
+			1e3 * oldSeconds, 1e3 * newSeconds, oldSeconds / newSeconds,
+			comparable ? "" : "  (old loader reads it differently)");
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+// Compares writePngParallel (PngWriter.hpp) with lodepng, which
+// Image::savePng used to call, on a synthetic render-like image: time,
+// file size, and whether lodepng decodes our file back to the same pixels.
+//
+//     PngEncodeBench [width [height [threads]]]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <lodepng/lodepng.h>
+
+#include "../PngWriter.hpp"
+#include "../ThreadPool.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//---------------------------------------------------------------------------------------
+static double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+static long fileSize(const string & filename)
+{
+	FILE * file = fopen(filename.c_str(), "rb");
+	if (!file) {
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+//---------------------------------------------------------------------------------------
+// Shaded spheres on a gradient with a little noise: long smooth runs like a
+// ray traced frame, but not so regular that it compresses to nothing.
+static vector<unsigned char> makeImage(uint width, uint height)
+{
+	mt19937 rng(488);
+	uniform_real_distribution<double> unit(0.0, 1.0);
+	normal_distribution<double> noise(0.0, 0.004);
+
+	struct Sphere { double x, y, r, red, green, blue; };
+	vector<Sphere> spheres(24);
+	for (Sphere & s : spheres) {
+		s = { unit(rng) * width, unit(rng) * height, (0.03 + 0.1 * unit(rng)) * width,
+			unit(rng), unit(rng), unit(rng) };
+	}
+
+	vector<unsigned char> rgb(3 * size_t(width) * height);
+	for (uint y = 0; y < height; ++y) {
+		for (uint x = 0; x < width; ++x) {
+			double colour[3] = { 0.2, 0.3, 0.4 + 0.4 * y / height };
+			for (const Sphere & s : spheres) {
+				double dx = (x - s.x) / s.r;
+				double dy = (y - s.y) / s.r;
+				double d2 = dx * dx + dy * dy;
+				if (d2 < 1.0) {
+					double shade = 0.2 + 0.8 * max(0.0, 0.5 * (sqrt(1.0 - d2) - dx - dy));
+					colour[0] = s.red * shade;
+					colour[1] = s.green * shade;
+					colour[2] = s.blue * shade;
+				}
+			}
+			for (int i = 0; i < 3; ++i) {
+				double c = min(1.0, max(0.0, colour[i] + noise(rng)));
+				rgb[3 * (size_t(y) * width + x) + i] = (unsigned char)(255 * c);
+			}
+		}
+	}
+	return rgb;
+}
+
+//---------------------------------------------------------------------------------------
+static bool decodesTo(const string & filename, const vector<unsigned char> & rgb,
+	uint width, uint height)
+{
+	vector<unsigned char> decoded;
+	unsigned decodedWidth = 0, decodedHeight = 0;
+	unsigned error = lodepng::decode(decoded, decodedWidth, decodedHeight, filename, LCT_RGB);
+	if (error) {
+		printf("  lodepng cannot decode %s: %s\n", filename.c_str(), lodepng_error_text(error));
+		return false;
+	}
+	return decodedWidth == width && decodedHeight == height && decoded == rgb;
+}
+
+//---------------------------------------------------------------------------------------
+static void report(const char * name, double seconds, double baseline, long size)
+{
+	printf("%-22s %8.3f s  %6.2fx  %10ld bytes\n", name, seconds, baseline / seconds, size);
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+	uint width = argc > 1 ? (uint)strtoul(argv[1], nullptr, 10) : 4096;
+	uint height = argc > 2 ? (uint)strtoul(argv[2], nullptr, 10) : width;
+	unsigned int threads = argc > 3 ? (unsigned int)strtoul(argv[3], nullptr, 10) : 0;
+	if (threads == 0) {
+		threads = ThreadPool::hardwareThreads();
+	}
+
+	printf("%u x %u image, %u threads\n", width, height, threads);
+	vector<unsigned char> rgb = makeImage(width, height);
+	size_t stride = 3 * size_t(width);
+	PngRowSource rows = [&rgb, stride](uint y, unsigned char * out) {
+		memcpy(out, &rgb[y * stride], stride);
+	};
+
+	const string lodepngFile = "PngEncodeBench-lodepng.png";
+	Clock::time_point start = Clock::now();
+	unsigned error = lodepng::encode(lodepngFile, rgb, width, height, LCT_RGB);
+	double lodepngSeconds = secondsSince(start);
+	if (error) {
+		printf("lodepng error: %s\n", lodepng_error_text(error));
+		return 1;
+	}
+	report("lodepng", lodepngSeconds, lodepngSeconds, fileSize(lodepngFile));
+	remove(lodepngFile.c_str());
+
+	bool ok = true;
+	vector<unsigned int> threadCounts = { 1 };
+	if (threads > 1) {
+		threadCounts.push_back(threads);
+	}
+	for (unsigned int count : threadCounts) {
+		string filename = "PngEncodeBench-" + to_string(count) + ".png";
+		start = Clock::now();
+		bool written = writePngParallel(filename, width, height, rows, count);
+		double seconds = secondsSince(start);
+
+		string name = "parallel, " + to_string(count) + (count == 1 ? " thread" : " threads");
+		report(name.c_str(), seconds, lodepngSeconds, fileSize(filename));
+		if (!written || !decodesTo(filename, rgb, width, height)) {
+			printf("  output does not match the input image\n");
+			ok = false;
+		}
+		remove(filename.c_str());
+	}
+
+	return ok ? 0 : 1;
+}
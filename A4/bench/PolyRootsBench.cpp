@@ -0,0 +1,173 @@
+// Compares the batched single precision solvers in polyroots_simd.hpp
+// against the scalar double precision ones in polyroots.hpp, for speed and
+// for agreement, on random polynomials.
+//
+//     PolyRootsBench [count]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../polyroots.hpp"
+#include "../polyroots_simd.hpp"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//---------------------------------------------------------------------------------------
+static double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------------------
+// Random monic polynomials of the given degree, half built from random real
+// roots (so there is always something to find) and half from random
+// coefficients.
+static vector<vector<float>> makePolynomials(size_t count, int degree, mt19937 & rng)
+{
+	uniform_real_distribution<float> value(-4.0f, 4.0f);
+	vector<vector<float>> coefficients(degree, vector<float>(count));
+
+	for (size_t i = 0; i < count; ++i) {
+		double c[5] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+		if (i % 2 == 0) {
+			for (int k = 0; k < degree; ++k) {
+				double root = value(rng);
+				for (int j = k + 1; j > 0; --j) {
+					c[j] -= root * c[j - 1];
+				}
+			}
+		} else {
+			for (int k = 1; k <= degree; ++k) {
+				c[k] = value(rng);
+			}
+		}
+		for (int k = 0; k < degree; ++k) {
+			coefficients[k][i] = float(c[k + 1]);
+		}
+	}
+	return coefficients;
+}
+
+//---------------------------------------------------------------------------------------
+struct Agreement {
+	size_t countMismatches = 0;
+	size_t inaccurate = 0;
+	double maxError = 0.0;
+};
+
+//---------------------------------------------------------------------------------------
+static void compare(const double * scalarRoots, size_t scalarCount,
+	const vector<vector<float>> & batchRoots, size_t i, uint8_t batchCount,
+	Agreement & agreement)
+{
+	if (scalarCount != batchCount) {
+		++agreement.countMismatches;
+		return;
+	}
+
+	vector<double> sorted(scalarRoots, scalarRoots + scalarCount);
+	sort(sorted.begin(), sorted.end());
+	for (size_t k = 0; k < scalarCount; ++k) {
+		double error = fabs(sorted[k] - batchRoots[k][i]) / max(1.0, fabs(sorted[k]));
+		agreement.maxError = max(agreement.maxError, error);
+		if (error > 1e-3) {
+			++agreement.inaccurate;
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+static void report(const char * name, size_t count, double scalarSeconds,
+	double batchSeconds, const Agreement & agreement)
+{
+	printf("%-10s scalar %7.2f ns  batched %7.2f ns  speedup %5.2fx  "
+		"count mismatches %.3f%%  error > 1e-3 %.3f%%  max relative error %.2g\n",
+		name, 1e9 * scalarSeconds / count, 1e9 * batchSeconds / count,
+		scalarSeconds / batchSeconds, 100.0 * agreement.countMismatches / count,
+		100.0 * agreement.inaccurate / count, agreement.maxError);
+}
+
+//---------------------------------------------------------------------------------------
+template <int Degree, typename Scalar, typename Batch>
+static void run(const char * name, size_t count, mt19937 & rng,
+	Scalar scalarSolve, Batch batchSolve)
+{
+	vector<vector<float>> coefficients = makePolynomials(count, Degree, rng);
+
+	vector<double> scalarRoots(count * Degree);
+	vector<size_t> scalarCounts(count);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < count; ++i) {
+		double c[Degree];
+		for (int k = 0; k < Degree; ++k) {
+			c[k] = coefficients[k][i];
+		}
+		scalarCounts[i] = scalarSolve(c, &scalarRoots[i * Degree]);
+	}
+	double scalarSeconds = secondsSince(start);
+
+	vector<vector<float>> batchRoots(Degree, vector<float>(count));
+	vector<uint8_t> batchCounts(count);
+	float * roots[Degree];
+	const float * in[Degree];
+	for (int k = 0; k < Degree; ++k) {
+		roots[k] = batchRoots[k].data();
+		in[k] = coefficients[k].data();
+	}
+	start = Clock::now();
+	batchSolve(in, roots, batchCounts.data());
+	double batchSeconds = secondsSince(start);
+
+	Agreement agreement;
+	for (size_t i = 0; i < count; ++i) {
+		compare(&scalarRoots[i * Degree], scalarCounts[i], batchRoots, i,
+			batchCounts[i], agreement);
+	}
+	report(name, count, scalarSeconds, batchSeconds, agreement);
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+	mt19937 rng(488);
+
+	printf("%zu polynomials per degree, %s packets of %d\n", count, simd::Name, simd::Width);
+
+	vector<float> ones(count, 1.0f);
+
+	run<2>("quadratic", count, rng,
+		[](const double * c, double * roots) {
+			return quadraticRoots(1.0, c[0], c[1], roots);
+		},
+		[count, &ones](const float * const * c, float * const * roots, uint8_t * counts) {
+			quadraticRootsBatch(count, ones.data(), c[0], c[1], roots, counts);
+		});
+
+	run<3>("cubic", count, rng,
+		[](const double * c, double * roots) {
+			return cubicRoots(c[0], c[1], c[2], roots);
+		},
+		[count](const float * const * c, float * const * roots, uint8_t * counts) {
+			cubicRootsBatch(count, c[0], c[1], c[2], roots, counts);
+		});
+
+	run<4>("quartic", count, rng,
+		[](const double * c, double * roots) {
+			return quarticRoots(c[0], c[1], c[2], c[3], roots);
+		},
+		[count](const float * const * c, float * const * roots, uint8_t * counts) {
+			quarticRootsBatch(count, c[0], c[1], c[2], c[3], roots, counts);
+		});
+
+	return 0;
+}
@@ -0,0 +1,364 @@
+// Renders the Assets scenes at fixed sizes with the A4 binary, a few times
+// each, and writes the median render time, rays per second and peak memory
+// of every scene and size to a JSON file. Given a baseline written by an
+// earlier run (--save-baseline), it also reports scenes whose median time
+// grew by more than the tolerance and exits with status 1 if any did.
+// Baselines only mean something on the machine that recorded them.
+//
+//     RenderBench [--runs N] [--sizes 256,512] [--scenes simple,hier]
+//                 [--a4 ./A4] [--out FILE] [--baseline FILE]
+//                 [--save-baseline] [--tolerance 0.1] [-- A4 options...]
+//
+// Run it from the A4 directory. Each run is a separate A4 process started
+// in Assets with --size and --stats, so the scene's own load and compile
+// time, and peak RSS, are measured just as a user would see them.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char * const DefaultScenes[] = {
+	"simple", "nonhier", "nonhier2", "hier", "instance", "simple-cows", "macho-cows"
+};
+
+struct Options {
+	uint runs;
+	vector<uint> sizes;
+	vector<string> scenes;
+	string a4;
+	string out;
+	string baseline;
+	bool saveBaseline;
+	double tolerance;
+	vector<string> a4Options;
+};
+
+// One scene at one size, over all runs.
+struct Result {
+	string scene;
+	uint size;
+	uint runs;
+	double medianSeconds;       // Render phase, as reported by A4
+	double medianTotalSeconds;  // Lua, compile, render and save
+	double raysPerSecond;
+	long peakRssKb;
+};
+
+//---------------------------------------------------------------------------------------
+static vector<string> split(const string & list)
+{
+	vector<string> items;
+	stringstream in(list);
+	string item;
+	while (getline(in, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+//---------------------------------------------------------------------------------------
+static string readFile(const string & filename)
+{
+	ifstream in(filename);
+	stringstream contents;
+	contents << in.rdbuf();
+	return contents.str();
+}
+
+//---------------------------------------------------------------------------------------
+// The number after "key": in json, or NAN. Good enough for the flat, one
+// key per line output of RenderStats and of this program, where the keys
+// looked up are unique.
+static double jsonNumber(const string & json, const string & key)
+{
+	size_t at = json.find("\"" + key + "\":");
+	if (at == string::npos) {
+		return NAN;
+	}
+	return strtod(json.c_str() + at + key.size() + 3, nullptr);
+}
+
+//---------------------------------------------------------------------------------------
+static string jsonString(const string & json, const string & key)
+{
+	size_t at = json.find("\"" + key + "\":");
+	if (at == string::npos) {
+		return "";
+	}
+	size_t begin = json.find('"', at + key.size() + 3);
+	size_t end = json.find('"', begin + 1);
+	return begin == string::npos || end == string::npos ? "" : json.substr(begin + 1, end - begin - 1);
+}
+
+//---------------------------------------------------------------------------------------
+static double median(vector<double> values)
+{
+	sort(values.begin(), values.end());
+	size_t n = values.size();
+	return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+//---------------------------------------------------------------------------------------
+// Run A4 on one scene in Assets, leaving its statistics in statsFile.
+// Returns the process's peak RSS in kilobytes, or -1 if it failed.
+static long runA4(const Options & options, const string & scene, uint size,
+	const string & statsFile)
+{
+	string sizeArg = to_string(size) + "x" + to_string(size);
+	string script = scene + ".lua";
+
+	vector<string> args = { options.a4, "--size", sizeArg, "--stats", statsFile };
+	args.insert(args.end(), options.a4Options.begin(), options.a4Options.end());
+	args.push_back(script);
+
+	vector<char *> argv;
+	for (string & arg : args) {
+		argv.push_back(&arg[0]);
+	}
+	argv.push_back(nullptr);
+
+	// The child would otherwise write out our buffered output again.
+	fflush(nullptr);
+	pid_t child = fork();
+	if (child < 0) {
+		return -1;
+	}
+	if (child == 0) {
+		// Scenes name their meshes relative to Assets.
+		if (chdir("Assets") == 0) {
+			// Keep the scene's own output out of the report.
+			if (!freopen("/dev/null", "w", stdout)) {
+				_exit(127);
+			}
+			execv(argv[0], argv.data());
+		}
+		_exit(127);
+	}
+
+	int status = 0;
+	struct rusage usage;
+	if (wait4(child, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;  // Bytes there, kilobytes on Linux
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+//---------------------------------------------------------------------------------------
+static bool measure(const Options & options, const string & scene, uint size,
+	const string & statsFile, Result & result)
+{
+	vector<double> renderSeconds, totalSeconds, rays;
+	long peakRss = 0;
+
+	for (uint run = 0; run < options.runs; ++run) {
+		remove(statsFile.c_str());
+		long rss = runA4(options, scene, size, statsFile);
+		string stats = readFile(statsFile);
+		if (rss < 0 || stats.empty()) {
+			cerr << scene << " at " << size << ": A4 failed" << endl;
+			return false;
+		}
+
+		// Do not leave the benchmark's images in Assets.
+		string output = jsonString(stats, "output");
+		if (!output.empty()) {
+			remove(("Assets/" + output).c_str());
+		}
+
+		renderSeconds.push_back(jsonNumber(stats, "render"));
+		totalSeconds.push_back(jsonNumber(stats, "total"));
+		rays.push_back(jsonNumber(stats, "primary") + jsonNumber(stats, "secondary")
+			+ jsonNumber(stats, "shadow"));
+		peakRss = max(peakRss, rss);
+	}
+	remove(statsFile.c_str());
+
+	result.scene = scene;
+	result.size = size;
+	result.runs = options.runs;
+	result.medianSeconds = median(renderSeconds);
+	result.medianTotalSeconds = median(totalSeconds);
+	result.raysPerSecond = median(rays) / result.medianSeconds;
+	result.peakRssKb = peakRss;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+// One scene per line, so a baseline can be read back a line at a time.
+static bool writeResults(const string & filename, const vector<Result> & results)
+{
+	ofstream out(filename);
+	out << "{\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result & r = results[i];
+		out << "    { \"scene\": \"" << r.scene << "\", \"size\": " << r.size
+		    << ", \"runs\": " << r.runs
+		    << ", \"median_seconds\": " << r.medianSeconds
+		    << ", \"median_total_seconds\": " << r.medianTotalSeconds
+		    << ", \"rays_per_second\": " << r.raysPerSecond
+		    << ", \"peak_rss_kb\": " << r.peakRssKb << " }"
+		    << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+	return bool(out);
+}
+
+//---------------------------------------------------------------------------------------
+// Median render seconds by scene and size, from a file writeResults wrote.
+static map<pair<string, uint>, double> readBaseline(const string & filename)
+{
+	map<pair<string, uint>, double> baseline;
+	ifstream in(filename);
+	string line;
+	while (getline(in, line)) {
+		string scene = jsonString(line, "scene");
+		if (!scene.empty()) {
+			baseline[make_pair(scene, (uint)jsonNumber(line, "size"))] =
+				jsonNumber(line, "median_seconds");
+		}
+	}
+	return baseline;
+}
+
+//---------------------------------------------------------------------------------------
+static bool parseOptions(int argc, char ** argv, Options & options)
+{
+	options.runs = 5;
+	options.sizes = { 256, 512 };
+	options.scenes.assign(begin(DefaultScenes), end(DefaultScenes));
+	options.a4 = "./A4";
+	options.out = "bench/RenderBench.json";
+	options.baseline = "bench/RenderBench.baseline.json";
+	options.saveBaseline = false;
+	options.tolerance = 0.1;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--") {
+			options.a4Options.assign(argv + i + 1, argv + argc);
+			break;
+		} else if (arg == "--runs" && hasValue) {
+			options.runs = max(1, atoi(argv[++i]));
+		} else if (arg == "--sizes" && hasValue) {
+			options.sizes.clear();
+			for (const string & size : split(argv[++i])) {
+				options.sizes.push_back(atoi(size.c_str()));
+			}
+		} else if (arg == "--scenes" && hasValue) {
+			options.scenes = split(argv[++i]);
+		} else if (arg == "--a4" && hasValue) {
+			options.a4 = argv[++i];
+		} else if (arg == "--out" && hasValue) {
+			options.out = argv[++i];
+		} else if (arg == "--baseline" && hasValue) {
+			options.baseline = argv[++i];
+		} else if (arg == "--save-baseline") {
+			options.saveBaseline = true;
+		} else if (arg == "--tolerance" && hasValue) {
+			options.tolerance = atof(argv[++i]);
+		} else {
+			cerr << "Unknown option " << arg << endl;
+			return false;
+		}
+	}
+
+	// The runs start in Assets.
+	char path[PATH_MAX];
+	if (!realpath(options.a4.c_str(), path)) {
+		cerr << "Cannot find A4 at " << options.a4 << endl;
+		return false;
+	}
+	options.a4 = path;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		return 2;
+	}
+
+	char cwd[PATH_MAX];
+	if (!getcwd(cwd, sizeof(cwd))) {
+		return 2;
+	}
+	string statsFile = string(cwd) + "/RenderBench.stats.json";
+
+	map<pair<string, uint>, double> baseline;
+	if (!options.saveBaseline) {
+		baseline = readBaseline(options.baseline);
+		if (baseline.empty()) {
+			cout << "No baseline in " << options.baseline
+			     << "; record one with --save-baseline" << endl;
+		}
+	}
+
+	vector<Result> results;
+	uint regressions = 0;
+	bool failed = false;
+
+	printf("%-12s %5s %10s %10s %12s %10s %9s\n",
+		"scene", "size", "median s", "total s", "Mrays/s", "RSS MB", "vs base");
+	for (const string & scene : options.scenes) {
+		for (uint size : options.sizes) {
+			Result result;
+			if (!measure(options, scene, size, statsFile, result)) {
+				failed = true;
+				continue;
+			}
+			results.push_back(result);
+
+			char change[32] = "";
+			auto base = baseline.find(make_pair(scene, size));
+			if (base != baseline.end() && base->second > 0.0) {
+				double ratio = result.medianSeconds / base->second;
+				bool regressed = ratio > 1.0 + options.tolerance;
+				snprintf(change, sizeof(change), "%+.1f%%%s", 100.0 * (ratio - 1.0),
+					regressed ? " !" : "");
+				regressions += regressed;
+			}
+
+			printf("%-12s %5u %10.4f %10.4f %12.3f %10.1f %9s\n",
+				scene.c_str(), size, result.medianSeconds, result.medianTotalSeconds,
+				result.raysPerSecond * 1e-6, result.peakRssKb / 1024.0, change);
+		}
+	}
+
+	const string & output = options.saveBaseline ? options.baseline : options.out;
+	if (!writeResults(output, results)) {
+		cerr << "Could not write " << output << endl;
+		return 2;
+	}
+	cout << "Wrote " << output << endl;
+
+	if (regressions > 0) {
+		cout << regressions << " scene(s) slower than the baseline by more than "
+		     << 100.0 * options.tolerance << "%" << endl;
+		return 1;
+	}
+	return failed ? 2 : 0;
+}
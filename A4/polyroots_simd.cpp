@@ -0,0 +1,335 @@
+/* //-------------------------------------------------------------------------
+//
+// CS488 -- Introduction to Computer Graphics
+//
+// polyroots_simd.hpp/polyroots_simd.cpp
+//
+// See polyroots_simd.hpp. The formulation follows polyroots.cpp case for
+// case so the two can be compared directly.
+//
+//------------------------------------------------------------------------- */
+
+#include "polyroots_simd.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace simd {
+
+static const float Infinity = std::numeric_limits<float>::infinity();
+
+//---------------------------------------------------------------------------------------
+static void sortPair(Float & a, Float & b)
+{
+	Float lo = min(a, b);
+	b = max(a, b);
+	a = lo;
+}
+
+//---------------------------------------------------------------------------------------
+static Mask finite(Float x)
+{
+	return abs(x) < Float(Infinity);
+}
+
+//---------------------------------------------------------------------------------------
+// Value of the monic polynomial x^degree + cs[0] x^(degree-1) + ... + cs[degree-1].
+static Float evaluate(int degree, const Float * cs, Float x)
+{
+	Float y(1.0f);
+	for (int j = 0; j < degree; ++j) {
+		y = y * x + cs[j];
+	}
+	return y;
+}
+
+//---------------------------------------------------------------------------------------
+// Lane-wise PolishRoot: up to three Newton-Raphson steps on a monic
+// polynomial, backing out of a step that made the residual worse.
+// Lanes holding +infinity are left alone.
+static Float polishRoot(int degree, const Float * cs, Float x)
+{
+	Float zero(0.0f);
+	Float lastX = x;
+	Float lastY(Infinity);
+	Mask done = andNot(x == x, finite(x));
+
+	for (int i = 0; i < 3; ++i) {
+		Float y(1.0f);
+		Float dydx = zero;
+		for (int j = 0; j < degree; ++j) {
+			dydx = dydx * x + y;
+			y = y * x + cs[j];
+		}
+
+		Mask stalled = dydx == zero;
+		Mask diverging = andNot(abs(y) > abs(lastY), done | stalled);
+		x = select(diverging, lastX, x);
+		done = done | stalled | diverging;
+
+		Float next = x - y / dydx;
+		lastX = select(done, lastX, x);
+		lastY = select(done, lastY, y);
+		x = select(done, x, next);
+	}
+
+	return x;
+}
+
+//---------------------------------------------------------------------------------------
+void quadraticRoots(Float A, Float B, Float C, Float roots[2])
+{
+	Float zero(0.0f);
+	Float inf(Infinity);
+
+	Float D = B * B - Float(4.0f) * A * C;
+	Float q = -(B + signNegative(B) * sqrt(max(D, zero))) * Float(0.5f);
+	Float quadratic0 = q / A;
+	Float quadratic1 = select(q == zero, quadratic0, C / q);
+	Float linear = -C / B;
+
+	Mask isQuadratic = andNot(D >= zero, A == zero);
+	Mask isLinear = andNot(A == zero, B == zero);
+
+	roots[0] = select(isQuadratic, quadratic0, select(isLinear, linear, inf));
+	roots[1] = select(isQuadratic, quadratic1, inf);
+	sortPair(roots[0], roots[1]);
+}
+
+//---------------------------------------------------------------------------------------
+void cubicRoots(Float p, Float q, Float r, Float roots[3])
+{
+	Float zero(0.0f);
+	Float one(1.0f);
+	Float third(1.0f / 3.0f);
+	Float inf(Infinity);
+
+	Float u = q - p * p * third;
+	Float v = r - p * q * third + Float(2.0f / 27.0f) * p * p * p;
+	Float w = Float(4.0f / 27.0f) * u * u * u + v * v;
+	Float pOver3 = p * third;
+
+	Mask oneReal = w > zero;
+
+	// One real root. Both of the scalar solver's branches are the same
+	// expression with the sign of v folded in.
+	Float single = inf;
+	if (any(oneReal)) {
+		Float m = sqrt(max(w, zero)) + abs(v);
+		Float sign = select(v < zero, one, -one);
+		Float k = apply(m * Float(0.5f), [](float x) { return std::cbrt(x); });
+		single = sign * (k - u / (Float(3.0f) * k)) - pOver3;
+	}
+
+	// Three real roots.
+	Float three0 = inf, three1 = inf, three2 = inf;
+	if (!all(oneReal)) {
+		Float s = sqrt(max(-u * third, zero));
+		Float t = -v / (Float(2.0f) * s * s * s);
+		// Clamping also turns the NaN from s == 0 into 1.
+		t = max(min(t, one), -one);
+
+		Float k = apply(t, [](float x) { return std::acos(x); }) * third;
+		Float cosk = apply(k, [](float x) { return std::cos(x); });
+		Float sink = sqrt(max(one - cosk * cosk, zero));
+		Float root3 = Float(1.732050807568878f);
+
+		three0 = Float(2.0f) * s * cosk - pOver3;
+		three1 = s * (-cosk + root3 * sink) - pOver3;
+		three2 = s * (-cosk - root3 * sink) - pOver3;
+	}
+
+	roots[0] = select(oneReal, single, three0);
+	roots[1] = select(oneReal, inf, three1);
+	roots[2] = select(oneReal, inf, three2);
+
+	sortPair(roots[0], roots[1]);
+	sortPair(roots[1], roots[2]);
+	sortPair(roots[0], roots[1]);
+}
+
+//---------------------------------------------------------------------------------------
+void quarticRoots(Float a, Float b, Float c, Float d, Float roots[4])
+{
+	Float zero(0.0f);
+	Float two(2.0f);
+	Float four(4.0f);
+	Float half(0.5f);
+	Float inf(Infinity);
+
+	// Find a real root of the resolvent cubic, choosing between the
+	// largest and smallest as the scalar solver does.
+	Float cubic[3] = {
+		-two * b,
+		b * b + a * c - four * d,
+		c * c - a * b * c + a * a * d
+	};
+	Float cubicSolutions[3];
+	cubicRoots(cubic[0], cubic[1], cubic[2], cubicSolutions);
+
+	Mask oneRoot = cubicSolutions[1] == inf;
+	Mask useSmallest = oneRoot | ((b < zero) & (d < zero));
+	Float y = polishRoot(3, cubic, select(useSmallest, cubicSolutions[0], cubicSolutions[2]));
+
+	Float g1 = a * half;
+	Float h1 = (b - y) * half;
+
+	Float n = a * a - four * y;
+	Float m = (b - y) * (b - y) - four * d;
+	Float en = b * b + two * abs(b * y) + y * y + four * abs(d);
+	Float em = a * a + four * abs(y);
+
+	Mask case1 = y < zero;
+	Mask case2 = andNot((y > zero) & (d > zero) & (b < zero), case1);
+	Mask case3 = andNot(andNot(y == y, case1), case2);
+	Mask useM = case2 | (case3 & (m * en > n * em));
+
+	Float gN = sqrt(max(n, zero));
+	Float hN = (a * h1 - c) / gN;
+	gN = gN * half;
+
+	Float hM = sqrt(max(m, zero));
+	Float gM = (a * h1 - c) / hM;
+	hM = hM * half;
+
+	Float g2 = select(useM, gM, gN);
+	Float h2 = select(useM, hM, hN);
+	Mask valid = (useM & (m > zero)) | andNot(n > zero, useM);
+
+	Mask gSignsDiffer = (g1 < zero) ^ (g2 < zero);
+	Float gSum = g1 + g2;
+	Float gDifference = g1 - g2;
+	Float G = select(gSignsDiffer,
+		select(gDifference == zero, gSum, y / gDifference), gSum);
+	Float g = select(gSignsDiffer,
+		gDifference, select(gSum == zero, gDifference, y / gSum));
+
+	Mask hSignsDiffer = (h1 < zero) ^ (h2 < zero);
+	Float hSum = h1 + h2;
+	Float hDifference = h1 - h2;
+	Float H = select(hSignsDiffer,
+		select(hDifference == zero, hSum, d / hDifference), hSum);
+	Float h = select(hSignsDiffer,
+		hDifference, select(hSum == zero, hDifference, d / hSum));
+
+	quadraticRoots(Float(1.0f), G, H, roots);
+	quadraticRoots(Float(1.0f), g, h, roots + 2);
+
+	// Polish, then drop anything that is not actually a root. The residual
+	// is judged relative to the size of the terms, as single precision
+	// cannot do better than that.
+	Float quartic[4] = { a, b, c, d };
+	for (int i = 0; i < 4; ++i) {
+		Float x = polishRoot(4, quartic, roots[i]);
+		Float ax = abs(x);
+		Float scale = (((ax + abs(a)) * ax + abs(b)) * ax + abs(c)) * ax + abs(d);
+		Float residual = abs(evaluate(4, quartic, x));
+		Mask isRoot = valid & finite(x)
+			& (residual <= Float(1e-4f) * max(scale, Float(1.0f)));
+		roots[i] = select(isRoot, x, inf);
+	}
+
+	sortPair(roots[0], roots[1]);
+	sortPair(roots[2], roots[3]);
+	sortPair(roots[0], roots[2]);
+	sortPair(roots[1], roots[3]);
+	sortPair(roots[1], roots[2]);
+}
+
+//---------------------------------------------------------------------------------------
+Float smallestRootAbove(const Float * roots, int n, Float tMin)
+{
+	Float result(Infinity);
+	for (int i = n - 1; i >= 0; --i) {
+		result = select(roots[i] > tMin, roots[i], result);
+	}
+	return result;
+}
+
+} // namespace simd
+
+//---------------------------------------------------------------------------------------
+// Runs solve over count polynomials Width at a time. The last partial
+// group is padded with zero coefficients and its extra lanes discarded.
+template <int Degree, int Coefficients, typename Solve>
+static void solveBatch(size_t count, const float * const coefficients[Coefficients],
+	float * const roots[Degree], uint8_t * counts, Solve solve)
+{
+	using namespace simd;
+
+	for (size_t base = 0; base < count; base += Width) {
+		size_t lanes = count - base < (size_t)Width ? count - base : (size_t)Width;
+
+		Float in[Coefficients];
+		for (int k = 0; k < Coefficients; ++k) {
+			if (lanes == (size_t)Width) {
+				in[k] = Float::load(coefficients[k] + base);
+			} else {
+				float padded[Width] = { 0.0f };
+				for (size_t i = 0; i < lanes; ++i) {
+					padded[i] = coefficients[k][base + i];
+				}
+				in[k] = Float::load(padded);
+			}
+		}
+
+		Float out[Degree];
+		solve(in, out);
+
+		// Missing roots are +infinity, so the count is the number of finite slots.
+		Float rootCount(0.0f);
+		for (int k = 0; k < Degree; ++k) {
+			rootCount = rootCount + select(finite(out[k]), Float(1.0f), Float(0.0f));
+			if (lanes == (size_t)Width) {
+				out[k].store(roots[k] + base);
+			} else {
+				float values[Width];
+				out[k].store(values);
+				for (size_t i = 0; i < lanes; ++i) {
+					roots[k][base + i] = values[i];
+				}
+			}
+		}
+
+		if (counts) {
+			float values[Width];
+			rootCount.store(values);
+			for (size_t i = 0; i < lanes; ++i) {
+				counts[base + i] = (uint8_t)values[i];
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+void quadraticRootsBatch(size_t count, const float * A, const float * B,
+	const float * C, float * const roots[2], uint8_t * counts)
+{
+	const float * const coefficients[3] = { A, B, C };
+	solveBatch<2, 3>(count, coefficients, roots, counts,
+		[](const simd::Float * in, simd::Float * out) {
+			simd::quadraticRoots(in[0], in[1], in[2], out);
+		});
+}
+
+//---------------------------------------------------------------------------------------
+void cubicRootsBatch(size_t count, const float * p, const float * q,
+	const float * r, float * const roots[3], uint8_t * counts)
+{
+	const float * const coefficients[3] = { p, q, r };
+	solveBatch<3, 3>(count, coefficients, roots, counts,
+		[](const simd::Float * in, simd::Float * out) {
+			simd::cubicRoots(in[0], in[1], in[2], out);
+		});
+}
+
+//---------------------------------------------------------------------------------------
+void quarticRootsBatch(size_t count, const float * a, const float * b,
+	const float * c, const float * d, float * const roots[4], uint8_t * counts)
+{
+	const float * const coefficients[4] = { a, b, c, d };
+	solveBatch<4, 4>(count, coefficients, roots, counts,
+		[](const simd::Float * in, simd::Float * out) {
+			simd::quarticRoots(in[0], in[1], in[2], in[3], out);
+		});
+}
@@ -0,0 +1,51 @@
+/* //-------------------------------------------------------------------------
+//
+// CS488 -- Introduction to Computer Graphics
+//
+// polyroots_simd.hpp/polyroots_simd.cpp
+//
+// Batched, single precision versions of the solvers in polyroots.hpp,
+// for intersecting ray packets with spheres, tori and other implicit
+// surfaces. Each call solves one polynomial per SIMD lane using the same
+// formulation as the scalar solver, but evaluates every case and picks
+// the result per lane with masks instead of branches.
+//
+// Roots come back sorted in ascending order. Lanes with fewer real roots
+// than the degree fill the remaining slots with +infinity, so the nearest
+// hit in front of a ray is always smallestRootAbove(roots, n, tMin).
+//
+//------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Simd.hpp"
+
+namespace simd {
+
+// A x^2 + B x + C
+void quadraticRoots(Float A, Float B, Float C, Float roots[2]);
+
+// x^3 + p x^2 + q x + r
+void cubicRoots(Float p, Float q, Float r, Float roots[3]);
+
+// x^4 + a x^3 + b x^2 + c x + d
+void quarticRoots(Float a, Float b, Float c, Float d, Float roots[4]);
+
+// The smallest of the n sorted roots that is greater than tMin, or +infinity.
+Float smallestRootAbove(const Float * roots, int n, Float tMin);
+
+} // namespace simd
+
+// Solve count polynomials stored as structure-of-arrays: the i-th polynomial
+// has coefficients A[i], B[i], ... as in the scalar solvers. roots[k][i]
+// receives the k-th smallest root of polynomial i (or +infinity) and, if
+// counts is not null, counts[i] the number of real roots found.
+void quadraticRootsBatch(size_t count, const float * A, const float * B,
+	const float * C, float * const roots[2], uint8_t * counts);
+void cubicRootsBatch(size_t count, const float * p, const float * q,
+	const float * r, float * const roots[3], uint8_t * counts);
+void quarticRootsBatch(size_t count, const float * a, const float * b,
+	const float * c, const float * d, float * const roots[4], uint8_t * counts);
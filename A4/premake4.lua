@@ -64,6 +64,63 @@ solution "CS488-Projects"
         includedirs (includeDirList)
         files { "*.cpp" }
 
+    -- Scalar vs. batched polynomial solvers; see bench/PolyRootsBench.cpp.
+    project "PolyRootsBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        includedirs (includeDirList)
+        files { "bench/PolyRootsBench.cpp", "polyroots.cpp", "polyroots_simd.cpp" }
+
+    -- Parallel PNG encoder vs. lodepng; see bench/PngEncodeBench.cpp.
+    project "PngEncodeBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        libdirs (libDirectories)
+        links { "lodepng", "pthread" }
+        includedirs (includeDirList)
+        files { "bench/PngEncodeBench.cpp", "PngWriter.cpp", "Deflate.cpp", "ThreadPool.cpp" }
+
+    -- .obj parser vs. the iostream loader it replaced; see bench/ObjLoadBench.cpp.
+    project "ObjLoadBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        includedirs (includeDirList)
+        files { "bench/ObjLoadBench.cpp", "ObjParser.cpp", "MappedFile.cpp" }
+
+    -- Generic vs. world space sphere and box tests; see bench/NonhierBench.cpp.
+    project "NonhierBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        includedirs (includeDirList)
+        files { "bench/NonhierBench.cpp", "Primitive.cpp", "polyroots.cpp" }
+
+    -- Times the Assets scenes with the A4 binary, optionally against a
+    -- stored baseline; see bench/RenderBench.cpp. Build A4 first.
+    project "RenderBench"
+        kind "ConsoleApp"
+        language "C++"
+        location "build"
+        objdir "build/bench"
+        targetdir "."
+        buildoptions (buildOptions)
+        files { "bench/RenderBench.cpp" }
+
     configuration "Debug"
         defines { "DEBUG" }
         flags { "Symbols" }
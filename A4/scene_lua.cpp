@@ -39,10 +39,19 @@
 
 #include <iostream>
 #include <cctype>
+#include <climits>
+#include <cmath>
 #include <cstring>
 #include <cstdio>
 #include <vector>
+#include <list>
 #include <map>
+#include <memory>
+
+#include <stdlib.h>
+#ifndef _WIN32
+#  include <limits.h>
+#endif
 
 #include "lua488.hpp"
 
@@ -54,10 +63,23 @@
 #include "Material.hpp"
 #include "PhongMaterial.hpp"
 #include "A4.hpp"
+#include "Arena.hpp"
 
-typedef std::map<std::string,Mesh*> MeshMap;
+// Meshes loaded so far, keyed on their canonical path so that different
+// spellings of the same file share one Mesh. The map does not keep a mesh
+// alive; it goes away with the last GeometryNode using it.
+typedef std::map<std::string,std::weak_ptr<Mesh>> MeshMap;
 static MeshMap mesh_map;
 
+// Where the running script's nodes, primitives, materials and lights are
+// made. run_lua owns it, so they all last until the script has finished,
+// through every render it makes.
+static Arena* scene_arena = nullptr;
+
+// Time spent in the script itself: since run_lua started it, or since the
+// last gr.render returned.
+static Stopwatch script_clock;
+
 // Uncomment the following line to enable debugging messages
 // #define GRLUA_ENABLE_DEBUG
 
@@ -113,6 +135,103 @@ void get_tuple(lua_State* L, int arg, T* data, int n)
   }
 }
 
+// Read the value at index as a whole number of at least minimum, or return
+// false. It is range checked before the cast, which is undefined otherwise;
+// written so that NaN fails too.
+bool get_whole(lua_State* L, int index, int minimum, unsigned int& result)
+{
+  double value = lua_tonumber(L, index);
+  if (!lua_isnumber(L, index) || !(value >= minimum && value <= UINT_MAX)
+      || value != std::floor(value)) {
+    return false;
+  }
+  result = (unsigned int)value;
+  return true;
+}
+
+// Read the options table at arg into settings, leaving whatever it does
+// not mention alone. Unknown options are errors, so that a misspelt one
+// does not quietly render with the default.
+void get_render_options(lua_State* L, int arg, RenderSettings& settings)
+{
+  luaL_checktype(L, arg, LUA_TTABLE);
+
+  lua_pushnil(L);
+  while (lua_next(L, arg) != 0) {
+    // The key is at -2 and the value at -1.
+    if (lua_type(L, -2) != LUA_TSTRING) {
+      luaL_error(L, "render options must have names");
+    }
+    const char* key = lua_tostring(L, -2);
+
+    auto whole = [&](int minimum) {
+      unsigned int value = 0;
+      if (!get_whole(L, -1, minimum, value)) {
+        luaL_error(L, "render option %s must be a whole number of at least %d", key, minimum);
+      }
+      return value;
+    };
+    auto number = [&]() {
+      if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0.0) {
+        luaL_error(L, "render option %s must be a number of at least 0", key);
+      }
+      return lua_tonumber(L, -1);
+    };
+    auto boolean = [&]() {
+      if (!lua_isboolean(L, -1)) {
+        luaL_error(L, "render option %s must be true or false", key);
+      }
+      return lua_toboolean(L, -1) != 0;
+    };
+    // Index of the value in names, a null-terminated list.
+    auto choice = [&](const char* const* names) {
+      const char* value = lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : "";
+      for (int i = 0; names[i]; ++i) {
+        if (std::strcmp(value, names[i]) == 0) {
+          return i;
+        }
+      }
+      luaL_error(L, "render option %s must be one of '%s' or '%s'", key, names[0], names[1]);
+      return 0;
+    };
+
+    static const char* const formats[] = { "float", "half", nullptr };
+    static const char* const accelerations[] = { "bvh", "none", nullptr };
+
+    if (std::strcmp(key, "threads") == 0) {
+      settings.threads = whole(0);
+    } else if (std::strcmp(key, "tile_size") == 0) {
+      settings.tileSize = whole(1);
+    } else if (std::strcmp(key, "samples") == 0) {
+      settings.samplesPerPixel = whole(1);
+    } else if (std::strcmp(key, "packets") == 0) {
+      settings.packetTracing = boolean();
+    } else if (std::strcmp(key, "aa_depth") == 0) {
+      settings.supersamplingDepth = whole(0);
+    } else if (std::strcmp(key, "aa_threshold") == 0) {
+      settings.supersamplingThreshold = (float)number();
+    } else if (std::strcmp(key, "max_depth") == 0) {
+      settings.maxDepth = whole(0);
+    } else if (std::strcmp(key, "ray_budget") == 0) {
+      settings.rayBudget = whole(0);
+    } else if (std::strcmp(key, "roulette_depth") == 0) {
+      settings.rouletteDepth = whole(0);
+    } else if (std::strcmp(key, "progressive") == 0) {
+      settings.checkpointInterval = number();
+    } else if (std::strcmp(key, "format") == 0) {
+      settings.imageFormat = choice(formats) == 0 ? Image::Format::Float : Image::Format::Half;
+    } else if (std::strcmp(key, "stream") == 0) {
+      settings.streamingOutput = boolean();
+    } else if (std::strcmp(key, "acceleration") == 0) {
+      settings.acceleration = choice(accelerations) == 0 ? Acceleration::Bvh : Acceleration::None;
+    } else {
+      luaL_error(L, "unknown render option %s", key);
+    }
+
+    lua_pop(L, 1);
+  }
+}
+
 // Create a node
 extern "C"
 int gr_node_cmd(lua_State* L)
@@ -123,7 +242,7 @@ int gr_node_cmd(lua_State* L)
   data->node = 0;
 
   const char* name = luaL_checkstring(L, 1);
-  data->node = new SceneNode(name);
+  data->node = scene_arena->make<SceneNode>(name);
 
   luaL_getmetatable(L, "gr.node");
   lua_setmetatable(L, -2);
@@ -141,7 +260,7 @@ int gr_joint_cmd(lua_State* L)
   data->node = 0;
 
   const char* name = luaL_checkstring(L, 1);
-  JointNode* node = new JointNode(name);
+  JointNode* node = scene_arena->make<JointNode>(name);
 
   double x[3], y[3];
   get_tuple(L, 2, x, 3);
@@ -168,7 +287,7 @@ int gr_sphere_cmd(lua_State* L)
   data->node = 0;
   
   const char* name = luaL_checkstring(L, 1);
-  data->node = new GeometryNode( name, new Sphere() );
+  data->node = scene_arena->make<GeometryNode>( name, scene_arena->make<Sphere>() );
 
   luaL_getmetatable(L, "gr.node");
   lua_setmetatable(L, -2);
@@ -186,7 +305,7 @@ int gr_cube_cmd(lua_State* L)
   data->node = 0;
   
   const char* name = luaL_checkstring(L, 1);
-  data->node = new GeometryNode(name, new Cube());
+  data->node = scene_arena->make<GeometryNode>(name, scene_arena->make<Cube>());
 
   luaL_getmetatable(L, "gr.node");
   lua_setmetatable(L, -2);
@@ -210,7 +329,8 @@ int gr_nh_sphere_cmd(lua_State* L)
 
   double radius = luaL_checknumber(L, 3);
 
-  data->node = new GeometryNode(name, new NonhierSphere(pos, radius));
+  data->node = scene_arena->make<GeometryNode>(name,
+    scene_arena->make<NonhierSphere>(pos, radius));
 
   luaL_getmetatable(L, "gr.node");
   lua_setmetatable(L, -2);
@@ -234,7 +354,7 @@ int gr_nh_box_cmd(lua_State* L)
 
   double size = luaL_checknumber(L, 3);
 
-  data->node = new GeometryNode(name, new NonhierBox(pos, size));
+  data->node = scene_arena->make<GeometryNode>(name, scene_arena->make<NonhierBox>(pos, size));
 
   luaL_getmetatable(L, "gr.node");
   lua_setmetatable(L, -2);
@@ -242,6 +362,24 @@ int gr_nh_box_cmd(lua_State* L)
   return 1;
 }
 
+// The absolute path of fname with symlinks and ".." resolved, or fname
+// itself if it cannot be resolved (e.g. it does not exist).
+static std::string canonical_path(const std::string& fname)
+{
+#ifdef _WIN32
+  char buffer[_MAX_PATH];
+  if (_fullpath(buffer, fname.c_str(), _MAX_PATH)) {
+    return buffer;
+  }
+#else
+  char buffer[PATH_MAX];
+  if (realpath(fname.c_str(), buffer)) {
+    return buffer;
+  }
+#endif
+  return fname;
+}
+
 // Create a polygonal mesh node
 extern "C"
 int gr_mesh_cmd(lua_State* L)
@@ -254,20 +392,19 @@ int gr_mesh_cmd(lua_State* L)
 	const char* name = luaL_checkstring(L, 1);
 	const char* obj_fname = luaL_checkstring(L, 2);
 
-	std::string sfname( obj_fname );
+	std::string sfname = canonical_path( obj_fname );
 
 	// Use a dictionary structure to make sure every mesh is loaded
-	// at most once.
-	auto i = mesh_map.find( sfname );
-	Mesh *mesh = nullptr;
-
-	if( i == mesh_map.end() ) {
-		mesh = new Mesh( obj_fname );
-	} else {
-		mesh = i->second;
+	// at most once, however many nodes use it.
+	std::weak_ptr<Mesh>& entry = mesh_map[sfname];
+	std::shared_ptr<Mesh> mesh = entry.lock();
+
+	if( !mesh ) {
+		mesh = std::make_shared<Mesh>( obj_fname, A4_DefaultSettings().meshLayout );
+		entry = mesh;
 	}
 
-	data->node = new GeometryNode( name, mesh );
+	data->node = scene_arena->make<GeometryNode>( name, mesh );
 
 	luaL_getmetatable(L, "gr.node");
 	lua_setmetatable(L, -2);
@@ -281,10 +418,6 @@ int gr_light_cmd(lua_State* L)
 {
   GRLUA_DEBUG_CALL;
 
-  gr_light_ud* data = (gr_light_ud*)lua_newuserdata(L, sizeof(gr_light_ud));
-  data->light = 0;
-
-  
   Light l;
 
   double col[3];
@@ -293,8 +426,64 @@ int gr_light_cmd(lua_State* L)
   get_tuple(L, 3, l.falloff, 3);
 
   l.colour = glm::vec3(col[0], col[1], col[2]);
-  
-  data->light = new Light(l);
+
+  // Optional, for an area light: {shape = 'rectangle', u = {...},
+  // v = {...}} or {shape = 'sphere', radius = r}, either with samples = n
+  // and adaptive = false; see Light.
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    int edges = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 4) != 0) {
+      const char* key = lua_type(L, -2) == LUA_TSTRING ? lua_tostring(L, -2) : "";
+      if (std::strcmp(key, "shape") == 0) {
+        const char* shape = lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : "";
+        if (std::strcmp(shape, "point") == 0) {
+          l.shape = LightShape::Point;
+        } else if (std::strcmp(shape, "rectangle") == 0) {
+          l.shape = LightShape::Rectangle;
+        } else if (std::strcmp(shape, "sphere") == 0) {
+          l.shape = LightShape::Sphere;
+        } else {
+          luaL_error(L, "light option shape must be one of 'point', 'rectangle' or 'sphere'");
+        }
+      } else if (std::strcmp(key, "u") == 0 || std::strcmp(key, "v") == 0) {
+        get_tuple(L, lua_gettop(L), key[0] == 'u' ? &l.u[0] : &l.v[0], 3);
+        ++edges;
+      } else if (std::strcmp(key, "radius") == 0) {
+        l.radius = lua_tonumber(L, -1);
+        if (!lua_isnumber(L, -1) || l.radius <= 0.0) {
+          luaL_error(L, "light option radius must be a number greater than 0");
+        }
+      } else if (std::strcmp(key, "samples") == 0) {
+        unsigned int samples = 0;
+        if (!get_whole(L, -1, 1, samples)) {
+          luaL_error(L, "light option samples must be a whole number of at least 1");
+        }
+        l.samples = samples;
+      } else if (std::strcmp(key, "adaptive") == 0) {
+        if (!lua_isboolean(L, -1)) {
+          luaL_error(L, "light option adaptive must be true or false");
+        }
+        l.adaptive = lua_toboolean(L, -1) != 0;
+      } else {
+        luaL_error(L, "unknown light option %s", key);
+      }
+      lua_pop(L, 1);
+    }
+
+    if (l.shape == LightShape::Rectangle && edges < 2) {
+      luaL_error(L, "a rectangle light needs edges u and v");
+    }
+    if (l.shape == LightShape::Sphere && l.radius <= 0.0) {
+      luaL_error(L, "a sphere light needs a radius");
+    }
+  }
+
+  // Made after reading the arguments, which it would otherwise follow on
+  // the stack.
+  gr_light_ud* data = (gr_light_ud*)lua_newuserdata(L, sizeof(gr_light_ud));
+  data->light = scene_arena->make<Light>(l);
 
   luaL_newmetatable(L, "gr.light");
   lua_setmetatable(L, -2);
@@ -302,6 +491,88 @@ int gr_light_cmd(lua_State* L)
   return 1;
 }
 
+// The size, viewing and lighting arguments gr.render and
+// gr.render_sequence share.
+struct render_args {
+  int width;
+  int height;
+  glm::vec3 eye;
+  glm::vec3 view;
+  glm::vec3 up;
+  double fov;
+  glm::vec3 ambient;
+  std::list<Light*> lights;
+};
+
+// Read render_args from the eight arguments starting at arg.
+void get_render_args(lua_State* L, int arg, render_args& args)
+{
+  args.width = luaL_checknumber(L, arg);
+  args.height = luaL_checknumber(L, arg + 1);
+
+  get_tuple(L, arg + 2, &args.eye[0], 3);
+  get_tuple(L, arg + 3, &args.view[0], 3);
+  get_tuple(L, arg + 4, &args.up[0], 3);
+
+  args.fov = luaL_checknumber(L, arg + 5);
+
+  double ambient_data[3];
+  get_tuple(L, arg + 6, ambient_data, 3);
+  args.ambient = glm::vec3(ambient_data[0], ambient_data[1], ambient_data[2]);
+
+  int lights_arg = arg + 7;
+  luaL_checktype(L, lights_arg, LUA_TTABLE);
+  int light_count = int(lua_rawlen(L, lights_arg));
+  
+  luaL_argcheck(L, light_count >= 1, lights_arg, "Tuple of lights expected");
+  for (int i = 1; i <= light_count; i++) {
+    lua_rawgeti(L, lights_arg, i);
+    gr_light_ud* ldata = (gr_light_ud*)luaL_checkudata(L, -1, "gr.light");
+    luaL_argcheck(L, ldata != 0, lights_arg, "Light expected");
+
+    args.lights.push_back(ldata->light);
+    lua_pop(L, 1);
+  }
+}
+
+// Raise the error get_render_args() would for the eight arguments starting
+// at arg, if any, without building anything: for callers that must not
+// have C++ objects alive when Lua unwinds.
+void check_render_args(lua_State* L, int arg)
+{
+  luaL_checknumber(L, arg);
+  luaL_checknumber(L, arg + 1);
+
+  double tuple[3];
+  get_tuple(L, arg + 2, tuple, 3);
+  get_tuple(L, arg + 3, tuple, 3);
+  get_tuple(L, arg + 4, tuple, 3);
+  luaL_checknumber(L, arg + 5);
+  get_tuple(L, arg + 6, tuple, 3);
+
+  int lights_arg = arg + 7;
+  luaL_checktype(L, lights_arg, LUA_TTABLE);
+  int light_count = int(lua_rawlen(L, lights_arg));
+  luaL_argcheck(L, light_count >= 1, lights_arg, "Tuple of lights expected");
+  for (int i = 1; i <= light_count; i++) {
+    lua_rawgeti(L, lights_arg, i);
+    gr_light_ud* ldata = (gr_light_ud*)luaL_checkudata(L, -1, "gr.light");
+    luaL_argcheck(L, ldata != 0, lights_arg, "Light expected");
+    lua_pop(L, 1);
+  }
+}
+
+// The render settings for a call with an optional options table at arg.
+// Anything the table leaves out comes from the command line.
+RenderSettings get_render_settings(lua_State* L, int arg)
+{
+  RenderSettings settings = A4_DefaultSettings();
+  if (!lua_isnoneornil(L, arg)) {
+    get_render_options(L, arg, settings);
+  }
+  return settings;
+}
+
 // Render a scene
 extern "C"
 int gr_render_cmd(lua_State* L)
@@ -313,41 +584,117 @@ int gr_render_cmd(lua_State* L)
 
   const char* filename = luaL_checkstring(L, 2);
 
-  int width = luaL_checknumber(L, 3);
-  int height = luaL_checknumber(L, 4);
+  render_args args;
+  get_render_args(L, 3, args);
+  RenderSettings settings = get_render_settings(L, 11);
 
-  glm::vec3 eye;
-  glm::vec3 view, up;
-  
-  get_tuple(L, 5, &eye[0], 3);
-  get_tuple(L, 6, &view[0], 3);
-  get_tuple(L, 7, &up[0], 3);
+	RenderStats stats;
+	stats.output = filename;
+	stats.addPhase("lua", script_clock.lap());
 
-  double fov = luaL_checknumber(L, 8);
+	// Flatten the scene graph once, up front; the renderer only sees this.
+	Stopwatch compile;
+	CompiledScene scene( root->node, settings.acceleration );
+	stats.addPhase("compile", compile.seconds());
+	stats.sceneBytes = scene_arena->used();
+	stats.sceneReservedBytes = scene_arena->reserved();
 
-  double ambient_data[3];
-  get_tuple(L, 9, ambient_data, 3);
-  glm::vec3 ambient(ambient_data[0], ambient_data[1], ambient_data[2]);
+	A4_RenderToFile(scene, filename, args.width, args.height, settings, args.eye, args.view,
+		args.up, args.fov, args.ambient, args.lights, &stats);
+	A4_ReportStats(stats);
 
-  luaL_checktype(L, 10, LUA_TTABLE);
-  int light_count = int(lua_rawlen(L, 10));
-  
-  luaL_argcheck(L, light_count >= 1, 10, "Tuple of lights expected");
-  std::list<Light*> lights;
-  for (int i = 1; i <= light_count; i++) {
-    lua_rawgeti(L, 10, i);
-    gr_light_ud* ldata = (gr_light_ud*)luaL_checkudata(L, -1, "gr.light");
-    luaL_argcheck(L, ldata != 0, 10, "Light expected");
+	script_clock.lap();
+	return 0;
+}
 
-    lights.push_back(ldata->light);
-    lua_pop(L, 1);
+// Render an animation: frames frames, each after calling update(frame)
+// with frame from 1 up so it can move nodes (e.g. reset_transform and
+// translate). The scene is compiled once and refitted between frames, and
+// the render threads and framebuffer are kept, so a frame costs little
+// more than tracing it. The first run of #s in filename is replaced by the
+// frame number, padded with zeros to as many digits.
+//
+// gr_render_sequence_cmd has checked the arguments. Returns false, with the
+// error on the stack, if the update function fails, for it to raise once
+// everything here has been destroyed: lua_error() would jump over the
+// destructors.
+static bool render_sequence(lua_State* L, const RenderSettings& settings)
+{
+  gr_node_ud* root = (gr_node_ud*)lua_touserdata(L, 1);
+  std::string pattern = lua_tostring(L, 2);
+  int frames = int(lua_tointeger(L, 3));
+
+  size_t hashes = pattern.find('#');
+  size_t digits = pattern.find_first_not_of('#', hashes);
+  digits = (digits == std::string::npos ? pattern.size() : digits) - hashes;
+
+  render_args args;
+  get_render_args(L, 4, args);
+
+  std::unique_ptr<CompiledScene> scene;
+  for (int frame = 1; frame <= frames; ++frame) {
+    lua_pushvalue(L, 12);
+    lua_pushinteger(L, frame);
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+      return false;
+    }
+
+    char number[32];
+    std::snprintf(number, sizeof(number), "%0*d", (int)digits, frame);
+    std::string filename = pattern.substr(0, hashes) + number
+      + pattern.substr(hashes + digits);
+
+    RenderStats stats;
+    stats.output = filename;
+    stats.addPhase("lua", script_clock.lap());
+
+    Stopwatch compile;
+    bool refitted = false;
+    if (scene) {
+      refitted = scene->refit(root->node);
+    } else {
+      scene.reset(new CompiledScene(root->node, settings.acceleration));
+    }
+    stats.addPhase("compile", compile.seconds());
+    stats.sceneBytes = scene_arena->used();
+    stats.sceneReservedBytes = scene_arena->reserved();
+
+    std::cout << "Frame " << frame << " of " << frames << ": " << filename
+      << (frame == 1 ? "" : refitted ? " (refitted)" : " (rebuilt)") << std::endl;
+    A4_RenderToFile(*scene, filename, args.width, args.height, settings, args.eye,
+      args.view, args.up, args.fov, args.ambient, args.lights, &stats);
+    A4_ReportStats(stats);
+
+    script_clock.lap();
   }
+  return true;
+}
 
-	Image im( width, height);
-	A4_Render(root->node, im, eye, view, up, fov, ambient, lights);
-    im.savePng( filename );
+// Every argument error is raised here, before render_sequence() makes
+// anything that would need destroying.
+extern "C"
+int gr_render_sequence_cmd(lua_State* L)
+{
+  GRLUA_DEBUG_CALL;
 
-	return 0;
+  gr_node_ud* root = (gr_node_ud*)luaL_checkudata(L, 1, "gr.node");
+  luaL_argcheck(L, root != 0, 1, "Root node expected");
+
+  const char* pattern = luaL_checkstring(L, 2);
+  luaL_argcheck(L, std::strchr(pattern, '#') != 0, 2, "# expected where the frame number goes");
+
+  int frames = luaL_checkinteger(L, 3);
+  luaL_argcheck(L, frames >= 1, 3, "Frame count expected");
+
+  check_render_args(L, 4);
+  luaL_checktype(L, 12, LUA_TFUNCTION);
+  // RenderSettings holds plain values only, so it may be read here.
+  RenderSettings settings = get_render_settings(L, 13);
+
+  if (!render_sequence(L, settings)) {
+    return lua_error(L);
+  }
+  return 0;
 }
 
 // Create a material
@@ -356,18 +703,53 @@ int gr_material_cmd(lua_State* L)
 {
   GRLUA_DEBUG_CALL;
   
-  gr_material_ud* data = (gr_material_ud*)lua_newuserdata(L, sizeof(gr_material_ud));
-  data->material = 0;
-  
   double kd[3], ks[3];
   get_tuple(L, 1, kd, 3);
   get_tuple(L, 2, ks, 3);
 
   double shininess = luaL_checknumber(L, 3);
-  
-  data->material = new PhongMaterial(glm::vec3(kd[0], kd[1], kd[2]),
-                                     glm::vec3(ks[0], ks[1], ks[2]),
-                                     shininess);
+
+  // Optional: {reflectivity = r, transparency = t, ior = n}; see
+  // PhongMaterial.
+  double reflectivity = 0.0, transparency = 0.0, ior = 1.0;
+  if (!lua_isnoneornil(L, 4)) {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_pushnil(L);
+    while (lua_next(L, 4) != 0) {
+      const char* key = lua_type(L, -2) == LUA_TSTRING ? lua_tostring(L, -2) : "";
+      if (!lua_isnumber(L, -1)) {
+        luaL_error(L, "material option %s must be a number", key);
+      }
+      double value = lua_tonumber(L, -1);
+      auto fraction = [&]() {
+        if (value < 0.0 || value > 1.0) {
+          luaL_error(L, "material option %s must be between 0 and 1", key);
+        }
+        return value;
+      };
+
+      if (std::strcmp(key, "reflectivity") == 0) {
+        reflectivity = fraction();
+      } else if (std::strcmp(key, "transparency") == 0) {
+        transparency = fraction();
+      } else if (std::strcmp(key, "ior") == 0) {
+        if (value <= 0.0) {
+          luaL_error(L, "material option ior must be greater than 0");
+        }
+        ior = value;
+      } else {
+        luaL_error(L, "unknown material option %s", key);
+      }
+      lua_pop(L, 1);
+    }
+  }
+
+  // Made after reading the arguments, which it would otherwise follow on
+  // the stack.
+  gr_material_ud* data = (gr_material_ud*)lua_newuserdata(L, sizeof(gr_material_ud));
+  data->material = scene_arena->make<PhongMaterial>(glm::vec3(kd[0], kd[1], kd[2]),
+                                                    glm::vec3(ks[0], ks[1], ks[2]),
+                                                    shininess, reflectivity, transparency, ior);
 
   luaL_newmetatable(L, "gr.material");
   lua_setmetatable(L, -2);
@@ -463,6 +845,21 @@ int gr_node_translate_cmd(lua_State* L)
   return 0;
 }
 
+// Set a node's transformation back to the identity, e.g. so that
+// gr.render_sequence's update can place it afresh each frame.
+extern "C"
+int gr_node_reset_transform_cmd(lua_State* L)
+{
+  GRLUA_DEBUG_CALL;
+  
+  gr_node_ud* selfdata = (gr_node_ud*)luaL_checkudata(L, 1, "gr.node");
+  luaL_argcheck(L, selfdata != 0, 1, "Node expected");
+
+  selfdata->node->set_transform(glm::mat4());
+
+  return 0;
+}
+
 // Rotate a node.
 extern "C"
 int gr_node_rotate_cmd(lua_State* L)
@@ -498,13 +895,8 @@ int gr_node_gc_cmd(lua_State* L)
   gr_node_ud* data = (gr_node_ud*)luaL_checkudata(L, 1, "gr.node");
   luaL_argcheck(L, data != 0, 1, "Node expected");
 
-  // Note that we don't delete the node here. This is because we still
-  // want the scene to be around when we close the lua interpreter,
-  // but at that point everything will be garbage collected.
-  //
-  // If data->node happened to be a reference-counting pointer, this
-  // will in fact just decrease lua's reference to it, so it's not a
-  // bad thing to include this line.
+  // Note that we don't delete the node here: it belongs to scene_arena,
+  // which frees every node together once the script is done.
   data->node = 0;
 
   return 0;
@@ -525,6 +917,7 @@ static const luaL_Reg grlib_functions[] = {
   {"mesh", gr_mesh_cmd},
   {"light", gr_light_cmd},
   {"render", gr_render_cmd},
+  {"render_sequence", gr_render_sequence_cmd},
   {0, 0}
 };
 
@@ -547,6 +940,7 @@ static const luaL_Reg grlib_node_methods[] = {
   {"scale", gr_node_scale_cmd},
   {"rotate", gr_node_rotate_cmd},
   {"translate", gr_node_translate_cmd},
+  {"reset_transform", gr_node_reset_transform_cmd},
   {"render", gr_render_cmd},
   {0, 0}
 };
@@ -556,6 +950,10 @@ static const luaL_Reg grlib_node_methods[] = {
 bool run_lua(const std::string& filename)
 {
   GRLUA_DEBUG("Importing scene from " << filename);
+  script_clock.lap();
+
+  Arena arena;
+  scene_arena = &arena;
   
   // Start a lua interpreter
   lua_State* L = luaL_newstate();
@@ -582,14 +980,17 @@ bool run_lua(const std::string& filename)
 
   GRLUA_DEBUG("Parsing the scene");
   // Now parse the actual scene
+  bool ok = true;
   if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 0, 0)) {
     std::cerr << "Error loading " << filename << ": " << lua_tostring(L, -1) << std::endl;
-    return false;
+    ok = false;
   }
   GRLUA_DEBUG("Closing the interpreter");
   
-  // Close the interpreter, free up any resources not needed
+  // Close the interpreter, free up any resources not needed, and then the
+  // scene, which its objects point into.
   lua_close(L);
+  scene_arena = nullptr;
 
-  return true;
+  return ok;
 }